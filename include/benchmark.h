@@ -0,0 +1,359 @@
+//
+// Benchmark mode: command line options, a scripted camera path and a recorder that
+// collects frame times and the profiler's per-pass times and writes them as JSON or CSV.
+//
+
+#ifndef CYBERPUNK_HALLWAY_BENCHMARK_H
+#define CYBERPUNK_HALLWAY_BENCHMARK_H
+
+#include <glad/glad.h>
+
+#include <glm/glm.hpp>
+
+#include <profiler.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <numeric>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+struct BenchmarkOptions
+{
+    int frames = 600;
+    // frames rendered before recording starts, so shader compilation and first uploads don't count
+    int warmup_frames = 30;
+    int width = 1280;
+    int height = 720;
+    // written as CSV if the name ends with ".csv", JSON otherwise
+    std::string output = "benchmark.json";
+    bool deferred_shading = false;
+    bool depth_pre_pass = false;
+    bool bloom = true;
+    bool packed_vertices = false;
+    int hallway_segments = 1;
+    std::uint32_t hallway_seed = 1;
+    bool occlusion_culling = true;
+    bool portal_culling = true;
+    bool level_of_detail = true;
+    bool meshlet_culling = true;
+};
+
+// returns the benchmark options if --bench is among the arguments, throws on malformed arguments and on options
+// given without --bench, which would otherwise be ignored
+inline std::optional<BenchmarkOptions> parse_benchmark_options(int argc, char** argv)
+{
+    BenchmarkOptions options;
+    bool enabled = false;
+    std::string_view first_option;
+    for (int i = 1; i < argc; i++) {
+        const std::string_view arg = argv[i];
+        if (arg != "--bench" && first_option.empty()) {
+            first_option = arg;
+        }
+        const auto value = [&]() -> std::string {
+            if (i + 1 >= argc) {
+                throw std::runtime_error("Missing value for " + std::string(arg));
+            }
+            return argv[++i];
+        };
+        if (arg == "--bench") {
+            enabled = true;
+        } else if (arg == "--frames") {
+            options.frames = std::stoi(value());
+        } else if (arg == "--warmup") {
+            options.warmup_frames = std::stoi(value());
+        } else if (arg == "--width") {
+            options.width = std::stoi(value());
+        } else if (arg == "--height") {
+            options.height = std::stoi(value());
+        } else if (arg == "--output") {
+            options.output = value();
+        } else if (arg == "--deferred") {
+            options.deferred_shading = true;
+        } else if (arg == "--depth-pre-pass") {
+            options.depth_pre_pass = true;
+        } else if (arg == "--no-bloom") {
+            options.bloom = false;
+        } else if (arg == "--packed-vertices") {
+            options.packed_vertices = true;
+        } else if (arg == "--segments") {
+            options.hallway_segments = std::stoi(value());
+        } else if (arg == "--seed") {
+            options.hallway_seed = static_cast<std::uint32_t>(std::stoul(value()));
+        } else if (arg == "--no-occlusion-culling") {
+            options.occlusion_culling = false;
+        } else if (arg == "--no-portal-culling") {
+            options.portal_culling = false;
+        } else if (arg == "--no-lod") {
+            options.level_of_detail = false;
+        } else if (arg == "--no-meshlet-culling") {
+            options.meshlet_culling = false;
+        } else {
+            throw std::runtime_error("Unknown argument " + std::string(arg));
+        }
+    }
+    if (options.frames <= 0 || options.warmup_frames < 0 || options.width <= 0 || options.height <= 0) {
+        throw std::runtime_error("Benchmark frame count and resolution must be positive");
+    }
+    if (options.hallway_segments <= 0) {
+        throw std::runtime_error("Hallway segment count must be positive");
+    }
+    if (!enabled) {
+        if (!first_option.empty()) {
+            throw std::runtime_error(std::string(first_option) + " is a benchmark option, it needs --bench");
+        }
+        return std::nullopt;
+    }
+    return options;
+}
+
+// closed Catmull-Rom spline through the control points, the camera looks along the path
+class CameraPath
+{
+public:
+    explicit CameraPath(std::vector<glm::vec3> points)
+        : m_points{std::move(points)}
+    {
+        if (m_points.size() < 2) {
+            throw std::runtime_error("Camera path needs at least two points");
+        }
+    }
+
+    // t in [0, 1) covers the whole loop
+    [[nodiscard]] glm::vec3 position(float t) const
+    {
+        const auto count = static_cast<int>(m_points.size());
+        const float segment_t = (t - std::floor(t)) * static_cast<float>(count);
+        const int segment = std::min(static_cast<int>(segment_t), count - 1);
+        const float s = segment_t - static_cast<float>(segment);
+        const auto point = [&](int i) { return m_points[((i % count) + count) % count]; };
+
+        const glm::vec3 p0 = point(segment - 1);
+        const glm::vec3 p1 = point(segment);
+        const glm::vec3 p2 = point(segment + 1);
+        const glm::vec3 p3 = point(segment + 2);
+        return 0.5f * ((2.0f * p1) + (p2 - p0) * s + (2.0f * p0 - 5.0f * p1 + 4.0f * p2 - p3) * s * s
+                       + (3.0f * p1 - p0 - 3.0f * p2 + p3) * s * s * s);
+    }
+
+    [[nodiscard]] glm::vec3 direction(float t) const
+    {
+        const glm::vec3 ahead = position(t + 0.01f) - position(t);
+        const float length = glm::length(ahead);
+        return length > 1e-6f ? ahead / length : glm::vec3{0.0f, 0.0f, -1.0f};
+    }
+
+    // camera angles in degrees looking along the path, in the convention of learnopengl's Camera
+    [[nodiscard]] float yaw(float t) const
+    {
+        const glm::vec3 front = direction(t);
+        return glm::degrees(std::atan2(front.z, front.x));
+    }
+
+    [[nodiscard]] float pitch(float t) const
+    {
+        return glm::degrees(std::asin(std::clamp(direction(t).y, -1.0f, 1.0f)));
+    }
+
+private:
+    std::vector<glm::vec3> m_points;
+};
+
+// measures whole frames and collects the per-pass times of a Profiler. The GPU runs asynchronously,
+// so frame boundaries wait for it with glFinish; that costs throughput, which is why the recorder
+// does nothing unless it is enabled.
+class BenchmarkRecorder
+{
+public:
+    using Clock = std::chrono::steady_clock;
+
+    explicit BenchmarkRecorder(bool enabled = false)
+        : m_enabled{enabled}
+    {
+    }
+
+    [[nodiscard]] bool enabled() const
+    {
+        return m_enabled;
+    }
+
+    void begin_frame()
+    {
+        if (!m_enabled) {
+            return;
+        }
+        glFinish();
+        m_frame_start = Clock::now();
+    }
+
+    // records the frame time and the latest times of the profiler sections that ran this frame,
+    // pass statistics are over the frames the pass ran in
+    void end_frame(const Profiler& profiler)
+    {
+        if (!m_enabled) {
+            return;
+        }
+        glFinish();
+        m_frame_times.push_back(std::chrono::duration<double, std::milli>(Clock::now() - m_frame_start).count());
+        for (const auto& section : profiler.sections()) {
+            if (!profiler.ran_this_frame(section)) {
+                continue;
+            }
+            auto pass = std::find_if(m_passes.begin(), m_passes.end(), [&](const Pass& p) { return p.name == section.name; });
+            if (pass == m_passes.end()) {
+                pass = m_passes.insert(m_passes.end(), Pass{section.name, {}, {}});
+            }
+            pass->gpu_times.push_back(section.gpu_ms);
+            pass->cpu_times.push_back(section.cpu_ms);
+        }
+    }
+
+    void clear()
+    {
+        m_frame_times.clear();
+        m_passes.clear();
+    }
+
+    // writes the statistics to a file, CSV if its name ends with ".csv" and JSON otherwise
+    void write(const std::string& filename, const BenchmarkOptions& options) const
+    {
+        std::ofstream file(filename);
+        if (!file) {
+            throw std::runtime_error("Can't open benchmark output " + filename);
+        }
+        const bool csv = filename.size() >= 4 && filename.compare(filename.size() - 4, 4, ".csv") == 0;
+        const auto config = configuration(options);
+        if (csv) {
+            for (const auto& [key, value] : config) {
+                file << "# " << key << '=' << value.text << '\n';
+            }
+            file << "name,min_ms,avg_ms,p50_ms,p95_ms,p99_ms,max_ms\n";
+            write_csv_row(file, "frame", statistics(m_frame_times));
+            for (const auto& pass : m_passes) {
+                write_csv_row(file, pass.name + " gpu", statistics(pass.gpu_times));
+                write_csv_row(file, pass.name + " cpu", statistics(pass.cpu_times));
+            }
+        } else {
+            file << "{\n"
+                 << "  \"frames\": " << m_frame_times.size() << ",\n";
+            for (const auto& [key, value] : config) {
+                file << "  \"" << key << "\": " << (value.quoted ? "\"" + value.text + "\"" : value.text) << ",\n";
+            }
+            file << "  \"frame_ms\": ";
+            write_json_statistics(file, statistics(m_frame_times));
+            file << ",\n  \"passes_ms\": {";
+            for (std::size_t i = 0; i < m_passes.size(); i++) {
+                file << (i ? ",\n    \"" : "\n    \"") << m_passes[i].name << "\": {\"gpu\": ";
+                write_json_statistics(file, statistics(m_passes[i].gpu_times));
+                file << ", \"cpu\": ";
+                write_json_statistics(file, statistics(m_passes[i].cpu_times));
+                file << "}";
+            }
+            file << "\n  }\n}\n";
+        }
+    }
+
+private:
+    struct ConfigValue
+    {
+        std::string text;
+        // strings are quoted in JSON, numbers and booleans aren't
+        bool quoted;
+    };
+
+    // the renderer and every option, so results of different settings can be told apart
+    static std::vector<std::pair<std::string, ConfigValue>> configuration(const BenchmarkOptions& options)
+    {
+        const auto flag = [](bool value) { return ConfigValue{value ? "true" : "false", false}; };
+        const auto number = [](auto value) { return ConfigValue{std::to_string(value), false}; };
+        const auto text = [](std::string value) {
+            std::replace(value.begin(), value.end(), '"', '\'');
+            return ConfigValue{std::move(value), true};
+        };
+        return {
+            {"renderer", text(gl_string(GL_RENDERER))},
+            {"requested_frames", number(options.frames)},
+            {"warmup_frames", number(options.warmup_frames)},
+            {"width", number(options.width)},
+            {"height", number(options.height)},
+            {"output", text(options.output)},
+            {"deferred_shading", flag(options.deferred_shading)},
+            {"depth_pre_pass", flag(options.depth_pre_pass)},
+            {"bloom", flag(options.bloom)},
+            {"packed_vertices", flag(options.packed_vertices)},
+            {"hallway_segments", number(options.hallway_segments)},
+            {"hallway_seed", number(options.hallway_seed)},
+            {"occlusion_culling", flag(options.occlusion_culling)},
+            {"portal_culling", flag(options.portal_culling)},
+            {"level_of_detail", flag(options.level_of_detail)},
+            {"meshlet_culling", flag(options.meshlet_culling)},
+        };
+    }
+
+    struct Pass
+    {
+        std::string name;
+        std::vector<double> gpu_times;
+        std::vector<double> cpu_times;
+    };
+
+    struct Statistics
+    {
+        double min{};
+        double avg{};
+        double p50{};
+        double p95{};
+        double p99{};
+        double max{};
+    };
+
+    static Statistics statistics(std::vector<double> times)
+    {
+        if (times.empty()) {
+            return {};
+        }
+        std::sort(times.begin(), times.end());
+        // nearest-rank percentile
+        const auto percentile = [&](double p) {
+            const auto rank = static_cast<std::size_t>(std::ceil(p / 100.0 * static_cast<double>(times.size())));
+            return times[std::clamp<std::size_t>(rank, 1, times.size()) - 1];
+        };
+        return {times.front(), std::accumulate(times.begin(), times.end(), 0.0) / static_cast<double>(times.size()),
+                percentile(50), percentile(95), percentile(99), times.back()};
+    }
+
+    static std::string gl_string(GLenum name)
+    {
+        const auto* value = reinterpret_cast<const char*>(glGetString(name));
+        std::string result = value ? value : "";
+        std::replace(result.begin(), result.end(), '"', '\'');
+        return result;
+    }
+
+    static void write_csv_row(std::ostream& out, const std::string& name, const Statistics& s)
+    {
+        out << name << ',' << s.min << ',' << s.avg << ',' << s.p50 << ',' << s.p95 << ',' << s.p99 << ',' << s.max << '\n';
+    }
+
+    static void write_json_statistics(std::ostream& out, const Statistics& s)
+    {
+        out << "{\"min\": " << s.min << ", \"avg\": " << s.avg << ", \"p50\": " << s.p50 << ", \"p95\": " << s.p95
+            << ", \"p99\": " << s.p99 << ", \"max\": " << s.max << "}";
+    }
+
+    bool m_enabled;
+    Clock::time_point m_frame_start;
+    std::vector<double> m_frame_times;
+    std::vector<Pass> m_passes;
+};
+
+#endif //CYBERPUNK_HALLWAY_BENCHMARK_H
@@ -0,0 +1,159 @@
+//
+// Minimal DDS container for block compressed textures with a full mip chain, written by tools/cook_textures
+// and read by TextureLoader. Only the legacy FourCC formats are used: DXT1 (BC1), DXT5 (BC3) and ATI2 (BC5).
+//
+
+#ifndef CYBERPUNK_HALLWAY_DDS_H
+#define CYBERPUNK_HALLWAY_DDS_H
+
+#include <glad/glad.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <optional>
+#include <string>
+#include <vector>
+
+// S3TC is an extension, not part of the core profile the GL loader was generated for
+#ifndef GL_COMPRESSED_RGB_S3TC_DXT1_EXT
+#define GL_COMPRESSED_RGB_S3TC_DXT1_EXT 0x83F0
+#endif
+#ifndef GL_COMPRESSED_RGBA_S3TC_DXT5_EXT
+#define GL_COMPRESSED_RGBA_S3TC_DXT5_EXT 0x83F3
+#endif
+#ifndef GL_COMPRESSED_SRGB_S3TC_DXT1_EXT
+#define GL_COMPRESSED_SRGB_S3TC_DXT1_EXT 0x8C4C
+#endif
+#ifndef GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT5_EXT
+#define GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT5_EXT 0x8C4F
+#endif
+
+namespace dds {
+
+constexpr std::uint32_t four_cc(char a, char b, char c, char d)
+{
+    return static_cast<std::uint32_t>(static_cast<unsigned char>(a)) | static_cast<std::uint32_t>(static_cast<unsigned char>(b)) << 8 |
+           static_cast<std::uint32_t>(static_cast<unsigned char>(c)) << 16 | static_cast<std::uint32_t>(static_cast<unsigned char>(d)) << 24;
+}
+
+constexpr std::uint32_t magic = four_cc('D', 'D', 'S', ' ');
+constexpr std::uint32_t bc1 = four_cc('D', 'X', 'T', '1');
+constexpr std::uint32_t bc3 = four_cc('D', 'X', 'T', '5');
+constexpr std::uint32_t bc5 = four_cc('A', 'T', 'I', '2');
+
+struct PixelFormat
+{
+    std::uint32_t size;
+    std::uint32_t flags;
+    std::uint32_t four_cc;
+    std::uint32_t rgb_bit_count;
+    std::uint32_t bit_masks[4];
+};
+
+struct Header
+{
+    std::uint32_t size;
+    std::uint32_t flags;
+    std::uint32_t height;
+    std::uint32_t width;
+    std::uint32_t pitch_or_linear_size;
+    std::uint32_t depth;
+    std::uint32_t mip_map_count;
+    std::uint32_t reserved1[11];
+    PixelFormat pixel_format;
+    std::uint32_t caps[4];
+    std::uint32_t reserved2;
+};
+static_assert(sizeof(Header) == 124);
+
+inline std::size_t block_size(std::uint32_t format)
+{
+    return format == bc1 ? 8 : 16;
+}
+
+// size of one mip level in bytes, blocks cover 4x4 pixels
+inline std::size_t level_size(std::uint32_t format, std::uint32_t width, std::uint32_t height)
+{
+    return std::size_t{(width + 3) / 4} * ((height + 3) / 4) * block_size(format);
+}
+
+struct Image
+{
+    std::uint32_t format{};
+    std::uint32_t width{};
+    std::uint32_t height{};
+    // compressed mip levels, largest first
+    std::vector<std::vector<std::uint8_t>> levels;
+};
+
+// nothing if the file is missing, truncated or in a format this reader doesn't know
+inline std::optional<Image> read(const std::string& path)
+{
+    std::ifstream file(path, std::ios::binary);
+    std::uint32_t file_magic{};
+    Header header{};
+    if (!file.read(reinterpret_cast<char*>(&file_magic), sizeof(file_magic)) || file_magic != magic ||
+        !file.read(reinterpret_cast<char*>(&header), sizeof(header)) || header.size != sizeof(Header)) {
+        return std::nullopt;
+    }
+    const std::uint32_t format = header.pixel_format.four_cc;
+    if ((format != bc1 && format != bc3 && format != bc5) || header.width == 0 || header.height == 0) {
+        return std::nullopt;
+    }
+
+    Image image{format, header.width, header.height, {}};
+    std::uint32_t width = header.width;
+    std::uint32_t height = header.height;
+    for (std::uint32_t level = 0; level < std::max(header.mip_map_count, 1u); level++) {
+        std::vector<std::uint8_t> data(level_size(format, width, height));
+        if (!file.read(reinterpret_cast<char*>(data.data()), static_cast<std::streamsize>(data.size()))) {
+            return std::nullopt;
+        }
+        image.levels.push_back(std::move(data));
+        width = std::max(width / 2, 1u);
+        height = std::max(height / 2, 1u);
+    }
+    return image;
+}
+
+inline bool write(const std::string& path, const Image& image)
+{
+    Header header{};
+    header.size = sizeof(Header);
+    // caps, height, width, pixel format, mip map count, linear size
+    header.flags = 0x1 | 0x2 | 0x4 | 0x1000 | 0x20000 | 0x80000;
+    header.height = image.height;
+    header.width = image.width;
+    header.pitch_or_linear_size = static_cast<std::uint32_t>(image.levels.empty() ? 0 : image.levels.front().size());
+    header.mip_map_count = static_cast<std::uint32_t>(image.levels.size());
+    header.pixel_format.size = sizeof(PixelFormat);
+    header.pixel_format.flags = 0x4; // four_cc is valid
+    header.pixel_format.four_cc = image.format;
+    header.caps[0] = 0x1000 | 0x400000 | 0x8; // texture, mip map, complex
+
+    std::ofstream file(path, std::ios::binary | std::ios::trunc);
+    file.write(reinterpret_cast<const char*>(&magic), sizeof(magic));
+    file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    for (const auto& level : image.levels) {
+        file.write(reinterpret_cast<const char*>(level.data()), static_cast<std::streamsize>(level.size()));
+    }
+    return static_cast<bool>(file);
+}
+
+// GL internal format of a DDS format
+inline GLenum gl_format(std::uint32_t format, bool srgb)
+{
+    if (format == bc1) {
+        return srgb ? GL_COMPRESSED_SRGB_S3TC_DXT1_EXT : GL_COMPRESSED_RGB_S3TC_DXT1_EXT;
+    }
+    if (format == bc3) {
+        return srgb ? GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT5_EXT : GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+    }
+    return GL_COMPRESSED_RG_RGTC2;
+}
+
+} // namespace dds
+
+#endif //CYBERPUNK_HALLWAY_DDS_H
@@ -0,0 +1,88 @@
+//
+// View frustum culling: bounding boxes are tested against the six planes of a view projection matrix
+// (Gribb and Hartmann's extraction). The test is conservative, boxes near the frustum's corners can be
+// reported visible although they are outside.
+//
+
+#ifndef CYBERPUNK_HALLWAY_FRUSTUM_H
+#define CYBERPUNK_HALLWAY_FRUSTUM_H
+
+#include <glm/glm.hpp>
+
+#include <array>
+#include <cmath>
+#include <cstddef>
+
+struct BoundingBox
+{
+    glm::vec3 min{0.0f};
+    glm::vec3 max{0.0f};
+
+    [[nodiscard]] glm::vec3 center() const
+    {
+        return (min + max) * 0.5f;
+    }
+
+    // the box around the transformed box (Arvo's method)
+    [[nodiscard]] BoundingBox transformed(const glm::mat4& transform) const
+    {
+        const glm::vec3 center{transform * glm::vec4(this->center(), 1.0f)};
+        const glm::vec3 extent = (max - min) * 0.5f;
+        glm::vec3 world_extent{0.0f};
+        for (int column = 0; column < 3; column++) {
+            world_extent += glm::abs(glm::vec3{transform[column]}) * extent[column];
+        }
+        return {center - world_extent, center + world_extent};
+    }
+};
+
+class Frustum
+{
+public:
+    // a frustum without planes, containing everything
+    Frustum() = default;
+
+    explicit Frustum(const glm::mat4& view_projection)
+    {
+        const auto row = [&](int i) {
+            return glm::vec4{view_projection[0][i], view_projection[1][i], view_projection[2][i], view_projection[3][i]};
+        };
+        // left, right, bottom, top, near, far
+        for (int axis = 0; axis < 3; axis++) {
+            m_planes[2 * axis] = row(3) + row(axis);
+            m_planes[2 * axis + 1] = row(3) - row(axis);
+        }
+    }
+
+    // the same frustum in the space the transform maps to world space, for testing object space bounds
+    [[nodiscard]] Frustum transformed(const glm::mat4& transform) const
+    {
+        Frustum result;
+        for (std::size_t i = 0; i < m_planes.size(); i++) {
+            // dot(plane, transform * p) is dot(transpose(transform) * plane, p)
+            result.m_planes[i] = glm::vec4{glm::dot(m_planes[i], transform[0]), glm::dot(m_planes[i], transform[1]),
+                                           glm::dot(m_planes[i], transform[2]), glm::dot(m_planes[i], transform[3])};
+        }
+        return result;
+    }
+
+    [[nodiscard]] bool intersects(const BoundingBox& box) const
+    {
+        for (const glm::vec4& plane : m_planes) {
+            // the corner furthest along the plane's normal
+            const glm::vec3 corner{plane.x > 0.0f ? box.max.x : box.min.x,
+                                   plane.y > 0.0f ? box.max.y : box.min.y,
+                                   plane.z > 0.0f ? box.max.z : box.min.z};
+            if (glm::dot(glm::vec3{plane}, corner) + plane.w < 0.0f) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+private:
+    // ax + by + cz + d >= 0 inside, not normalized as only the sign is used
+    std::array<glm::vec4, 6> m_planes{};
+};
+
+#endif //CYBERPUNK_HALLWAY_FRUSTUM_H
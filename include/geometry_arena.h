@@ -0,0 +1,211 @@
+//
+// Static geometry arena: all vertices of one vertex format share a vertex buffer, all indices share an index
+// buffer and one vertex array object describes them, so meshes are suballocated ranges drawn with
+// glDrawElementsBaseVertex and switching between them needs no state changes. Buffers grow by copying on the
+// GPU, so nothing is kept on the CPU. Ranges are never freed, the arena is for geometry that lives as long as
+// the scene.
+//
+
+#ifndef CYBERPUNK_HALLWAY_GEOMETRY_ARENA_H
+#define CYBERPUNK_HALLWAY_GEOMETRY_ARENA_H
+
+#include <glad/glad.h>
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <vector>
+
+class GeometryArena
+{
+public:
+    struct VertexFormat
+    {
+        GLsizei stride;
+        // sets the attribute pointers of the format for vertices starting at the bound GL_ARRAY_BUFFER's start
+        void (*setup_attributes)();
+    };
+
+    // a mesh's range in the arena
+    struct Range
+    {
+        const VertexFormat* format{};
+        GLint base_vertex{};
+        // in bytes
+        std::size_t index_offset{};
+        GLsizei index_count{};
+        GLenum index_type{GL_UNSIGNED_INT};
+
+        bool operator==(const Range&) const = default;
+    };
+
+    GeometryArena() = default;
+    GeometryArena(const GeometryArena&) = delete;
+    GeometryArena& operator=(const GeometryArena&) = delete;
+
+    ~GeometryArena()
+    {
+        for (const Pool& pool : m_pools) {
+            glDeleteVertexArrays(1, &pool.vao);
+            glDeleteBuffers(1, &pool.vertex_buffer);
+            glDeleteBuffers(1, &pool.index_buffer);
+        }
+    }
+
+    // copies the vertices and indices into the arena, indices are relative to the first vertex.
+    // The format must outlive the arena, formats are told apart by their address.
+    template<typename Index>
+    Range add(const VertexFormat& format, std::span<const std::byte> vertices, std::span<const Index> indices)
+    {
+        static_assert(sizeof(Index) == 2 || sizeof(Index) == 4);
+        Pool& pool = find_pool(format);
+        glBindVertexArray(pool.vao);
+
+        const std::size_t vertex_offset = pool.vertex_size;
+        reserve(pool, pool.vertex_buffer, GL_ARRAY_BUFFER, pool.vertex_capacity, vertex_offset + vertices.size());
+        glBindBuffer(GL_ARRAY_BUFFER, pool.vertex_buffer);
+        glBufferSubData(GL_ARRAY_BUFFER, static_cast<GLintptr>(vertex_offset), static_cast<GLsizeiptr>(vertices.size()), vertices.data());
+        pool.vertex_size += vertices.size();
+        const std::size_t index_offset = append_indices(pool, indices);
+
+        glBindVertexArray(0);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+        return {&format, static_cast<GLint>(vertex_offset / static_cast<std::size_t>(format.stride)), index_offset,
+                static_cast<GLsizei>(indices.size()), sizeof(Index) == 2 ? GLenum{GL_UNSIGNED_SHORT} : GLenum{GL_UNSIGNED_INT}};
+    }
+
+    // copies more indices for the vertices of a range, e.g. a coarser level of detail of the same mesh
+    template<typename Index>
+    Range add_indices(const Range& vertices, std::span<const Index> indices)
+    {
+        static_assert(sizeof(Index) == 2 || sizeof(Index) == 4);
+        Pool& pool = find_pool(*vertices.format);
+        glBindVertexArray(pool.vao);
+        const std::size_t index_offset = append_indices(pool, indices);
+        glBindVertexArray(0);
+        return {vertices.format, vertices.base_vertex, index_offset, static_cast<GLsizei>(indices.size()),
+                sizeof(Index) == 2 ? GLenum{GL_UNSIGNED_SHORT} : GLenum{GL_UNSIGNED_INT}};
+    }
+
+    // binds the vertex array of the range's format and draws the range
+    void draw(const Range& range) const
+    {
+        bind(range.format);
+        draw_bound(range);
+    }
+
+    // binds the vertex array of a format, ranges of the format can then be drawn with draw_bound()
+    void bind(const VertexFormat* format) const
+    {
+        for (const Pool& pool : m_pools) {
+            if (pool.format == format) {
+                glBindVertexArray(pool.vao);
+                return;
+            }
+        }
+    }
+
+    static void draw_bound(const Range& range)
+    {
+        glDrawElementsBaseVertex(GL_TRIANGLES, range.index_count, range.index_type,
+                                 reinterpret_cast<const void*>(range.index_offset), range.base_vertex);
+    }
+
+    static void draw_bound_instanced(const Range& range, GLsizei instances)
+    {
+        glDrawElementsInstancedBaseVertex(GL_TRIANGLES, range.index_count, range.index_type,
+                                          reinterpret_cast<const void*>(range.index_offset), instances, range.base_vertex);
+    }
+
+    // draws parts of a range with one call, the offsets are in bytes from the start of the index buffer
+    static void multi_draw_bound(const Range& range, const GLsizei* counts, const void* const* offsets, const GLint* base_vertices,
+                                 GLsizei parts)
+    {
+        glMultiDrawElementsBaseVertex(GL_TRIANGLES, counts, range.index_type, offsets, parts, base_vertices);
+    }
+
+    // bytes of vertices and indices stored in all formats
+    [[nodiscard]] std::size_t size() const
+    {
+        std::size_t size = 0;
+        for (const Pool& pool : m_pools) {
+            size += pool.vertex_size + pool.index_size;
+        }
+        return size;
+    }
+
+private:
+    static constexpr std::size_t initial_capacity = 1 << 20;
+
+    struct Pool
+    {
+        const VertexFormat* format{};
+        unsigned vao{};
+        unsigned vertex_buffer{};
+        unsigned index_buffer{};
+        std::size_t vertex_size{};
+        std::size_t vertex_capacity{};
+        std::size_t index_size{};
+        std::size_t index_capacity{};
+    };
+
+    Pool& find_pool(const VertexFormat& format)
+    {
+        for (Pool& pool : m_pools) {
+            if (pool.format == &format) {
+                return pool;
+            }
+        }
+        Pool& pool = m_pools.emplace_back();
+        pool.format = &format;
+        glGenVertexArrays(1, &pool.vao);
+        return pool;
+    }
+
+    // copies the indices to the end of the pool's index buffer, returns their offset. Expects the pool's vertex
+    // array to be bound.
+    template<typename Index>
+    static std::size_t append_indices(Pool& pool, std::span<const Index> indices)
+    {
+        // indices must be aligned to their size, 4 covers both types
+        const std::size_t index_offset = (pool.index_size + 3) & ~std::size_t{3};
+        const std::size_t index_bytes = indices.size() * sizeof(Index);
+        reserve(pool, pool.index_buffer, GL_ELEMENT_ARRAY_BUFFER, pool.index_capacity, index_offset + index_bytes);
+        glBufferSubData(GL_ELEMENT_ARRAY_BUFFER, static_cast<GLintptr>(index_offset), static_cast<GLsizeiptr>(index_bytes), indices.data());
+        pool.index_size = index_offset + index_bytes;
+        return index_offset;
+    }
+
+    // grows a buffer to at least the size, keeping its contents. Expects the pool's vertex array to be bound,
+    // which records the index buffer and the vertex buffer for the attributes.
+    static void reserve(const Pool& pool, unsigned& buffer, GLenum target, std::size_t& capacity, std::size_t size)
+    {
+        if (size <= capacity) {
+            glBindBuffer(target, buffer);
+            return;
+        }
+        const std::size_t new_capacity = std::max({size, capacity * 2, initial_capacity});
+        unsigned new_buffer{};
+        glGenBuffers(1, &new_buffer);
+        glBindBuffer(target, new_buffer);
+        glBufferData(target, static_cast<GLsizeiptr>(new_capacity), nullptr, GL_STATIC_DRAW);
+        if (buffer != 0) {
+            glBindBuffer(GL_COPY_READ_BUFFER, buffer);
+            glBindBuffer(GL_COPY_WRITE_BUFFER, new_buffer);
+            glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, static_cast<GLsizeiptr>(capacity));
+            glBindBuffer(GL_COPY_READ_BUFFER, 0);
+            glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+            glDeleteBuffers(1, &buffer);
+        }
+        buffer = new_buffer;
+        capacity = new_capacity;
+        if (target == GL_ARRAY_BUFFER) {
+            pool.format->setup_attributes();
+        }
+    }
+
+    std::vector<Pool> m_pools;
+};
+
+#endif //CYBERPUNK_HALLWAY_GEOMETRY_ARENA_H
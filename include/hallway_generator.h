@@ -0,0 +1,264 @@
+//
+// Procedural hallway: a corridor of segments laid out like the original room. The floors, the walls and the
+// ceilings of a few consecutive segments are merged into one mesh each, so the corridor takes few draws while
+// chunks behind the camera can still be culled. Props are returned as instance transforms per prop type and
+// every segment gets two lights. Each segment is a cell of a portal graph, connected to its neighbours by
+// the opening between them. The first segment is the hand placed room, the following ones vary its layout
+// with a random generator seeded from the options, so the same options always give the same corridor.
+//
+
+#ifndef CYBERPUNK_HALLWAY_HALLWAY_GENERATOR_H
+#define CYBERPUNK_HALLWAY_HALLWAY_GENERATOR_H
+
+#include <glm/glm.hpp>
+#include <glm/gtc/constants.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <learnopengl/mesh_edited.h>
+#include <portals.h>
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <random>
+#include <span>
+#include <stdexcept>
+#include <vector>
+
+struct HallwayOptions
+{
+    int segments = 1;
+    float segment_length = 10.f;
+    float width = 5.f;
+    float height = 4.f;
+    // world size of one repetition of the surface textures
+    float texture_size = 3.f;
+    // segments merged into one chunk of surfaces
+    int chunk_segments = 4;
+    std::uint32_t seed = 1;
+};
+
+enum class Prop
+{
+    door,
+    vending_machine,
+    arcade,
+    lamp,
+    trash,
+    poster,
+    bottle,
+    count
+};
+
+constexpr std::size_t prop_count = static_cast<std::size_t>(Prop::count);
+
+// the surfaces of consecutive segments, without textures
+struct HallwayChunk
+{
+    MeshData floor;
+    MeshData walls;
+    MeshData ceiling;
+};
+
+struct Hallway
+{
+    float width{};
+    float height{};
+    float length{};
+    float segment_length{};
+    std::size_t chunk_segments{};
+    std::vector<HallwayChunk> chunks;
+    // instances of each prop, ordered by segment
+    std::array<std::vector<glm::mat4>, prop_count> props;
+    // per segment, where its instances of each prop start
+    std::vector<std::array<std::size_t, prop_count>> segment_props;
+    std::vector<glm::vec3> light_positions;
+    // the segments are the cells
+    PortalGraph portals;
+
+    [[nodiscard]] const std::vector<glm::mat4>& instances(Prop prop) const
+    {
+        return props[static_cast<std::size_t>(prop)];
+    }
+
+    [[nodiscard]] std::span<const glm::mat4> instances(Prop prop, std::size_t segment) const
+    {
+        const auto& all = instances(prop);
+        const std::size_t first = segment_props[segment][static_cast<std::size_t>(prop)];
+        const std::size_t last = segment + 1 < segment_props.size() ? segment_props[segment + 1][static_cast<std::size_t>(prop)] : all.size();
+        return std::span<const glm::mat4>(all).subspan(first, last - first);
+    }
+
+    // the segment containing the position, the nearest one if it's outside the hallway
+    [[nodiscard]] std::size_t segment_at(const glm::vec3& position) const
+    {
+        const float segment = std::floor(-position.z / segment_length);
+        return static_cast<std::size_t>(std::clamp(segment, 0.f, static_cast<float>(segment_props.size() - 1)));
+    }
+};
+
+namespace hallway_detail {
+
+// adds a rectangle given counterclockwise from its bottom left corner. Texture coordinates are the position
+// along the rectangle's edges in texture repetitions, measured from the origin so that neighbouring
+// rectangles continue each other's texture.
+inline void add_quad(MeshData& mesh, const std::array<glm::vec3, 4>& corners, float texture_size)
+{
+    const glm::vec3 u_axis = glm::normalize(corners[1] - corners[0]);
+    const glm::vec3 v_axis = glm::normalize(corners[3] - corners[0]);
+    const glm::vec3 normal = glm::normalize(glm::cross(corners[0] - corners[1], corners[0] - corners[2]));
+    const glm::vec3 bitangent = glm::cross(normal, u_axis);
+
+    const auto first = static_cast<unsigned>(mesh.vertices.size());
+    for (const glm::vec3& corner : corners) {
+        const glm::vec2 tex_coords{glm::dot(corner, u_axis) / texture_size, glm::dot(corner, v_axis) / texture_size};
+        mesh.vertices.push_back({corner, normal, tex_coords, u_axis, bitangent});
+    }
+    // bottom left, bottom right, top right and top right, top left, bottom left
+    for (const unsigned index : {0u, 1u, 2u, 2u, 3u, 0u}) {
+        mesh.indices.push_back(first + index);
+    }
+}
+
+inline glm::mat4 place(const glm::vec3& position, float yaw, float scale)
+{
+    glm::mat4 model = glm::translate(glm::mat4(1.f), position);
+    model = glm::rotate(model, yaw, glm::vec3(0.f, 1.f, 0.f));
+    return glm::scale(model, glm::vec3(scale));
+}
+
+inline glm::mat4 ceiling_lamp(const glm::vec3& position, float yaw)
+{
+    glm::mat4 model = glm::translate(glm::mat4(1.f), position);
+    model = glm::rotate(model, glm::pi<float>(), glm::vec3(1.f, 0.f, 0.f));
+    model = glm::rotate(model, yaw, glm::vec3(0.f, 1.f, 0.f));
+    return glm::scale(model, glm::vec3(0.03f));
+}
+
+inline glm::mat4 lying_bottle(const glm::vec3& position, float roll)
+{
+    glm::mat4 model = glm::translate(glm::mat4(1.f), position);
+    model = glm::rotate(model, glm::pi<float>() / 2.f, glm::vec3(1.f, 0.f, 0.f));
+    model = glm::rotate(model, roll, glm::vec3(0.f, 0.f, 1.f));
+    return glm::scale(model, glm::vec3(0.01f));
+}
+
+} // namespace hallway_detail
+
+// throws if the options describe an empty hallway
+inline Hallway generate_hallway(const HallwayOptions& options)
+{
+    using namespace hallway_detail;
+    if (options.segments <= 0 || options.chunk_segments <= 0 || options.segment_length <= 0.f || options.width <= 0.f || options.height <= 0.f) {
+        throw std::runtime_error("Hallway needs at least one segment and a positive size");
+    }
+
+    const float w = options.width;
+    const float h = options.height;
+    const float l = options.segment_length;
+    const float half_pi = glm::pi<float>() / 2.f;
+
+    Hallway hallway;
+    hallway.width = w;
+    hallway.height = h;
+    hallway.length = l * static_cast<float>(options.segments);
+    hallway.segment_length = l;
+    hallway.chunk_segments = static_cast<std::size_t>(options.chunk_segments);
+    hallway.segment_props.reserve(static_cast<std::size_t>(options.segments));
+    hallway.portals = PortalGraph{static_cast<std::size_t>(options.segments)};
+    hallway.chunks.resize(static_cast<std::size_t>((options.segments + options.chunk_segments - 1) / options.chunk_segments));
+    hallway.light_positions.reserve(2 * static_cast<std::size_t>(options.segments));
+
+    const auto add = [&](Prop prop, const glm::mat4& model) {
+        hallway.props[static_cast<std::size_t>(prop)].push_back(model);
+    };
+
+    std::mt19937 random{options.seed};
+    const auto uniform = [&](float min, float max) {
+        return std::uniform_real_distribution<float>{min, max}(random);
+    };
+    const auto chance = [&](float probability) {
+        return std::bernoulli_distribution{probability}(random);
+    };
+
+    for (int segment = 0; segment < options.segments; segment++) {
+        // the segment spans z from front to back
+        const float front = -l * static_cast<float>(segment);
+        const float back = front - l;
+        HallwayChunk& chunk = hallway.chunks[static_cast<std::size_t>(segment / options.chunk_segments)];
+        auto& first_props = hallway.segment_props.emplace_back();
+        for (std::size_t prop = 0; prop < prop_count; prop++) {
+            first_props[prop] = hallway.props[prop].size();
+        }
+        if (segment > 0) {
+            const auto cell = static_cast<std::size_t>(segment);
+            hallway.portals.add_portal(cell - 1, cell, {glm::vec3{0.f, 0.f, front}, {w, 0.f, front}, {w, h, front}, {0.f, h, front}});
+        }
+
+        add_quad(chunk.floor, {glm::vec3{0.f, 0.f, front}, {w, 0.f, front}, {w, 0.f, back}, {0.f, 0.f, back}}, options.texture_size);
+        add_quad(chunk.walls, {glm::vec3{0.f, 0.f, front}, {0.f, 0.f, back}, {0.f, h, back}, {0.f, h, front}}, options.texture_size);
+        add_quad(chunk.walls, {glm::vec3{w, 0.f, back}, {w, 0.f, front}, {w, h, front}, {w, h, back}}, options.texture_size);
+        add_quad(chunk.ceiling, {glm::vec3{w, h, front}, {0.f, h, front}, {0.f, h, back}, {w, h, back}}, options.texture_size);
+
+        // every segment is lit from the ceiling at its front and from the right wall at three quarters
+        add(Prop::lamp, ceiling_lamp({w / 2.f, h, front - 0.2f}, 0.f));
+        add(Prop::lamp, ceiling_lamp({w - 0.2f, h, front - 3.f * l / 4.f}, half_pi));
+        hallway.light_positions.push_back({w - 0.5f, h - 0.5f, front - 3.f * l / 4.f});
+        hallway.light_positions.push_back({w / 2.f, h - 0.5f, front - 0.5f});
+
+        if (segment == 0) {
+            add(Prop::arcade, place({0.55f, 0.f, front - l / 3.f}, half_pi, 0.45f));
+            add(Prop::vending_machine, place({0.4f, 0.f, front - 2.f * l / 3.f}, half_pi, 1.4f));
+            add(Prop::door, place({w - 0.1f, 0.f, front - l / 2.f}, -half_pi, 1.f));
+            add(Prop::door, place({w - 0.1f, 0.f, front - l / 4.f}, -half_pi, 1.f));
+            add(Prop::poster, place({w - 0.03f, h / 2.f, front - 3.f * l / 4.f}, -half_pi, 1.2f));
+            add(Prop::trash, place({w / 2.f, 0.f, front - 1.f}, 0.f, 1.f));
+            add(Prop::bottle, lying_bottle({w / 3.f, 0.07f, front - l / 2.f}, -glm::pi<float>() / 12.f));
+            continue;
+        }
+
+        // the left wall has two machine slots, which may stay empty
+        for (const float slot : {l / 3.f, 2.f * l / 3.f}) {
+            const float z = front - slot + uniform(-0.5f, 0.5f);
+            switch (std::uniform_int_distribution<int>{0, 2}(random)) {
+            case 0:
+                add(Prop::arcade, place({0.55f, 0.f, z}, half_pi, 0.45f));
+                break;
+            case 1:
+                add(Prop::vending_machine, place({0.4f, 0.f, z}, half_pi, 1.4f));
+                break;
+            default:
+                break;
+            }
+        }
+        // doors and a poster on the right wall
+        for (const float slot : {l / 4.f, l / 2.f}) {
+            if (chance(0.75f)) {
+                add(Prop::door, place({w - 0.1f, 0.f, front - slot}, -half_pi, 1.f));
+            }
+        }
+        if (chance(0.5f)) {
+            add(Prop::poster, place({w - 0.03f, h / 2.f, front - 3.f * l / 4.f}, -half_pi, 1.2f));
+        }
+        // litter anywhere in the middle of the floor
+        const int trash_count = std::uniform_int_distribution<int>{1, 3}(random);
+        for (int i = 0; i < trash_count; i++) {
+            add(Prop::trash, place({uniform(1.2f, w - 1.2f), 0.f, uniform(back + 0.5f, front - 0.5f)}, uniform(0.f, 2.f * glm::pi<float>()), 1.f));
+        }
+        if (chance(0.5f)) {
+            add(Prop::bottle, lying_bottle({uniform(1.f, w - 1.f), 0.07f, uniform(back + 0.5f, front - 0.5f)}, uniform(-glm::pi<float>(), glm::pi<float>())));
+        }
+    }
+
+    // the ends of the corridor, with a door in the far one
+    const float end = -hallway.length;
+    add_quad(hallway.chunks.front().walls, {glm::vec3{w, 0.f, 0.f}, {0.f, 0.f, 0.f}, {0.f, h, 0.f}, {w, h, 0.f}}, options.texture_size);
+    add_quad(hallway.chunks.back().walls, {glm::vec3{0.f, 0.f, end}, {w, 0.f, end}, {w, h, end}, {0.f, h, end}}, options.texture_size);
+    add(Prop::door, place({w / 2.f, 0.f, end + 0.1f}, 0.f, 1.f));
+
+    return hallway;
+}
+
+#endif //CYBERPUNK_HALLWAY_HALLWAY_GENERATOR_H
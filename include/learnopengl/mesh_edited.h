@@ -10,10 +10,21 @@
 
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtc/packing.hpp>
 
+#include <geometry_arena.h>
 #include <learnopengl/shader.h>
+#include <material.h>
+#include <texture_registry.h>
 
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <span>
 #include <string>
+#include <string_view>
+#include <utility>
 #include <vector>
 
 struct Vertex {
@@ -29,118 +40,279 @@ struct Vertex {
     glm::vec3 Bitangent;
 };
 
+// how a Mesh stores its vertices on the GPU
+enum class VertexLayout {
+    // Vertex as is, 56 bytes
+    full,
+    // PackedVertex, 20 bytes, used for meshes whose texture coordinates fit half floats
+    packed
+};
+
+// positions are normalized int16 relative to the mesh's bounding box, normal and tangent 10 bit snorm with
+// the bitangent's sign in the tangent's w, texture coordinates half floats. The bitangent is rebuilt in the shader.
+struct PackedVertex {
+    std::int16_t Position[4];
+    std::uint32_t Normal;
+    std::uint32_t Tangent;
+    std::uint32_t TexCoords;
+};
+static_assert(sizeof(PackedVertex) == 20);
 
+// meshes with at most this many vertices use 16 bit indices
+constexpr std::size_t maxShortIndexVertices = 65536;
 
 struct Texture {
-    unsigned int id;
+    // keeps the texture alive while a mesh uses it
+    TextureHandle handle;
     std::string type;
     std::string path;
 };
 
-class Mesh {
-public:
-    // mesh Data
+// levels of detail of a mesh, including the full one
+constexpr std::size_t maxLodLevels = 4;
+
+// a simplified index buffer over the vertices of a mesh
+struct MeshLodData {
+    std::vector<unsigned int> indices;
+    // object space distance the simplified surface is off from the original, roughly
+    float error;
+};
+
+// the same, e.g. pointing into a mapped cache file
+struct MeshLodView {
+    std::span<const unsigned int> indices;
+    float error;
+};
+
+// a cluster of neighbouring triangles, a contiguous part of the index buffer of a mesh's full level
+struct Meshlet {
+    std::uint32_t firstIndex;
+    std::uint32_t indexCount;
+    // object space bounding sphere
+    glm::vec3 center;
+    float radius;
+    // the triangles are back facing for a camera at p if
+    // dot(center - p, coneAxis) >= coneCutoff * length(center - p) + radius, a cutoff of 1 never holds
+    glm::vec3 coneAxis;
+    float coneCutoff;
+};
+static_assert(sizeof(Meshlet) == 40);
+
+// CPU side mesh data, only lives until the mesh is uploaded
+struct MeshData {
     std::vector<Vertex>       vertices;
     std::vector<unsigned int> indices;
     std::vector<Texture>      textures;
+    // coarser levels of detail, coarsest last
+    std::vector<MeshLodData>  lods;
+    std::vector<Meshlet>      meshlets;
+};
+
+// attribute pointers of the vertex formats, for the GeometryArena
+inline void setupVertexAttributes()
+{
+    // A great thing about structs is that their memory layout is sequential for all its items.
+    // The effect is that we can simply pass a pointer to the struct and it translates perfectly to a glm::vec3/2 array which
+    // again translates to 3/2 floats which translates to a byte array.
+    // vertex Positions
+    glEnableVertexAttribArray(0);
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)0);
+    // vertex normals
+    glEnableVertexAttribArray(1);
+    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, Normal));
+    // vertex texture coords
+    glEnableVertexAttribArray(2);
+    glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, TexCoords));
+    // vertex tangent
+    glEnableVertexAttribArray(3);
+    glVertexAttribPointer(3, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, Tangent));
+    // vertex bitangent
+    glEnableVertexAttribArray(4);
+    glVertexAttribPointer(4, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, Bitangent));
+}
+
+inline void setupPackedVertexAttributes()
+{
+    // vertex Positions
+    glEnableVertexAttribArray(0);
+    glVertexAttribPointer(0, 3, GL_SHORT, GL_TRUE, sizeof(PackedVertex), (void*)offsetof(PackedVertex, Position));
+    // vertex normals
+    glEnableVertexAttribArray(1);
+    glVertexAttribPointer(1, 4, GL_INT_2_10_10_10_REV, GL_TRUE, sizeof(PackedVertex), (void*)offsetof(PackedVertex, Normal));
+    // vertex texture coords
+    glEnableVertexAttribArray(2);
+    glVertexAttribPointer(2, 2, GL_HALF_FLOAT, GL_FALSE, sizeof(PackedVertex), (void*)offsetof(PackedVertex, TexCoords));
+    // vertex tangent and bitangent sign
+    glEnableVertexAttribArray(3);
+    glVertexAttribPointer(3, 4, GL_INT_2_10_10_10_REV, GL_TRUE, sizeof(PackedVertex), (void*)offsetof(PackedVertex, Tangent));
+}
+
+inline const GeometryArena::VertexFormat vertexFormat{sizeof(Vertex), setupVertexAttributes};
+inline const GeometryArena::VertexFormat packedVertexFormat{sizeof(PackedVertex), setupPackedVertexAttributes};
+
+// a range of a GeometryArena, the vertex and index data aren't kept after the upload
+class Mesh {
+public:
+    // a coarser level of detail, drawn from the mesh's vertices
+    struct Lod {
+        GeometryArena::Range geometry;
+        float error;
+    };
+
+    std::vector<Texture>      textures;
+    // the first texture of every type, computed once so drawing the mesh doesn't compare type names
+    Material material;
+
+    GeometryArena::Range geometry;
+    // level i is lods[i - 1], level 0 is geometry
+    std::vector<Lod> lods;
+    // clusters of geometry for culling parts of the mesh, kept on the CPU. Empty for small meshes
+    std::vector<Meshlet> meshlets;
+    // object space bounding box of the vertices
+    glm::vec3 boundsMin{0.0f};
+    glm::vec3 boundsMax{0.0f};
+    // the layout actually used, packing falls back to the full layout if the mesh doesn't fit it
+    VertexLayout layout{VertexLayout::full};
+    // object space position = positionOffset + positionScale * vertex position, identity for the full layout
+    glm::vec3 positionScale{1.0f};
+    glm::vec3 positionOffset{0.0f};
+    // constructor, the vertices and indices are released once they are in the arena
+    Mesh(GeometryArena& arena, MeshData&& data, VertexLayout layout = VertexLayout::full)
+        : textures(std::move(data.textures)), material(materialOf(textures)), meshlets(std::move(data.meshlets)), arena(&arena)
+    {
+        std::vector<MeshLodView> lodViews;
+        for (const MeshLodData& lod : data.lods)
+            lodViews.push_back({lod.indices, lod.error});
+        // now that we have all the required data, copy it into the arena's buffers.
+        setupMesh(data.vertices, data.indices, lodViews, layout);
+        data.vertices = {};
+        data.indices = {};
+        data.lods = {};
+    }
+    // uploads the vertex and index data directly from the spans (e.g. a mapped cache file) without a copy
+    Mesh(GeometryArena& arena, std::span<const Vertex> vertices, std::span<const unsigned int> indices, std::span<const MeshLodView> lods,
+         std::span<const Meshlet> meshlets, std::vector<Texture> textures, VertexLayout layout = VertexLayout::full)
+        : textures(std::move(textures)), material(materialOf(this->textures)), meshlets(meshlets.begin(), meshlets.end()), arena(&arena)
+    {
+        setupMesh(vertices, indices, lods, layout);
+    }
 
-    unsigned int VAO{};
-    std::string glslIdentifierPrefix;
-    // constructor
-    Mesh(std::vector<Vertex> vertices, std::vector<unsigned int> indices, std::vector<Texture> textures)
+    [[nodiscard]] std::size_t lodCount() const
     {
-        this->vertices = vertices;
-        this->indices = indices;
-        this->textures = textures;
+        return lods.size() + 1;
+    }
 
-        // now that we have all the required data, set the vertex buffers and its attribute pointers.
-        setupMesh();
+    // levels past the coarsest give the coarsest
+    [[nodiscard]] const GeometryArena::Range& lodGeometry(std::size_t level) const
+    {
+        return level == 0 || lods.empty() ? geometry : lods[std::min(level, lods.size()) - 1].geometry;
     }
 
-    // render the mesh
-    void Draw(Shader &shader)
+    [[nodiscard]] float lodError(std::size_t level) const
     {
-        // bind appropriate textures
-        unsigned int diffuseNr  = 1;
-        unsigned int specularNr = 1;
-        unsigned int normalNr   = 1;
-        unsigned int heightNr   = 1;
-        unsigned int emissionNr = 1;
-        for(unsigned int i = 0; i < textures.size(); i++)
-        {
-            glActiveTexture(GL_TEXTURE0 + i); // active proper texture unit before binding
-            // retrieve texture number (the N in diffuse_textureN)
-            std::string number;
-            std::string name = textures[i].type;
-            if(name == "texture_diffuse")
-                number = std::to_string(diffuseNr++);
-            else if(name == "texture_specular")
-                number = std::to_string(specularNr++); // transfer unsigned int to stream
-            else if(name == "texture_normal")
-                number = std::to_string(normalNr++); // transfer unsigned int to stream
-            else if(name == "texture_height")
-                number = std::to_string(heightNr++); // transfer unsigned int to stream
-            else if(name == "texture_emission")
-                number = std::to_string(emissionNr++); // transfer unsigned int to stream
-
-            // now set the sampler to the correct texture unit
-            glUniform1i(glGetUniformLocation(shader.ID, (glslIdentifierPrefix + name + number).c_str()), i);
-            // and finally bind the texture
-            glBindTexture(GL_TEXTURE_2D, textures[i].id);
+        return level == 0 || lods.empty() ? 0.0f : lods[std::min(level, lods.size()) - 1].error;
+    }
+
+    Mesh(const Mesh&) = delete;
+    Mesh& operator=(const Mesh&) = delete;
+    Mesh(Mesh&&) noexcept = default;
+    Mesh& operator=(Mesh&&) noexcept = default;
+
+private:
+    GeometryArena* arena;
+
+    static Material materialOf(const std::vector<Texture>& textures)
+    {
+        Material material;
+        for (const Texture& texture : textures) {
+            for (std::size_t unit = 0; unit < Material::unit_count; unit++) {
+                // sampler names are the type followed by the number
+                std::string_view type = Material::sampler_names[unit];
+                type.remove_suffix(1);
+                if (material.textures[unit] == 0 && texture.type == type)
+                    material.textures[unit] = texture.handle.id();
+            }
         }
+        return material;
+    }
+
+    // texture coordinates up to this size keep an error below 1/2048 as half floats
+    static constexpr float maxPackedTexCoord = 2.0f;
 
+    // copies the vertices and the indices of every level into the arena
+    void setupMesh(std::span<const Vertex> vertices, std::span<const unsigned int> indices, std::span<const MeshLodView> lodViews,
+                   VertexLayout requestedLayout)
+    {
+        if (!vertices.empty()) {
+            boundsMin = boundsMax = vertices.front().Position;
+            for (const Vertex& vertex : vertices) {
+                boundsMin = glm::min(boundsMin, vertex.Position);
+                boundsMax = glm::max(boundsMax, vertex.Position);
+            }
+        }
 
+        const bool texCoordsFit = std::all_of(vertices.begin(), vertices.end(), [](const Vertex& vertex) {
+            return std::abs(vertex.TexCoords.x) <= maxPackedTexCoord && std::abs(vertex.TexCoords.y) <= maxPackedTexCoord;
+        });
+        if (requestedLayout == VertexLayout::packed && texCoordsFit)
+            setupPackedVertices(vertices, indices);
+        else
+            addToArena(vertexFormat, std::as_bytes(vertices), indices, vertices.size());
 
-        // draw mesh
-        glBindVertexArray(VAO);
-        glDrawElements(GL_TRIANGLES, indices.size(), GL_UNSIGNED_INT, 0);
-        glBindVertexArray(0);
+        lods.reserve(lodViews.size());
+        for (const MeshLodView& lod : lodViews)
+            lods.push_back({addLodToArena(lod.indices, vertices.size()), lod.error});
+    }
 
-        // always good practice to set everything back to defaults once configured.
-        glActiveTexture(GL_TEXTURE0);
+    void addToArena(const GeometryArena::VertexFormat& format, std::span<const std::byte> vertices, std::span<const unsigned int> indices,
+                    std::size_t vertexCount)
+    {
+        layout = &format == &packedVertexFormat ? VertexLayout::packed : VertexLayout::full;
+        if (vertexCount <= maxShortIndexVertices)
+        {
+            const std::vector<std::uint16_t> shortIndices(indices.begin(), indices.end());
+            geometry = arena->add(format, vertices, std::span<const std::uint16_t>(shortIndices));
+        }
+        else
+            geometry = arena->add(format, vertices, indices);
     }
 
-private:
-    // render data
-    unsigned int VBO{}, EBO{};
+    // the indices of a level use the index type of the full mesh
+    GeometryArena::Range addLodToArena(std::span<const unsigned int> indices, std::size_t vertexCount)
+    {
+        if (vertexCount <= maxShortIndexVertices)
+        {
+            const std::vector<std::uint16_t> shortIndices(indices.begin(), indices.end());
+            return arena->add_indices(geometry, std::span<const std::uint16_t>(shortIndices));
+        }
+        return arena->add_indices(geometry, indices);
+    }
 
-    // initializes all the buffer objects/arrays
-    void setupMesh()
+    void setupPackedVertices(std::span<const Vertex> vertices, std::span<const unsigned int> indices)
     {
-        // create buffers/arrays
-        glGenVertexArrays(1, &VAO);
-        glGenBuffers(1, &VBO);
-        glGenBuffers(1, &EBO);
-
-        glBindVertexArray(VAO);
-        // load data into vertex buffers
-        glBindBuffer(GL_ARRAY_BUFFER, VBO);
-        // A great thing about structs is that their memory layout is sequential for all its items.
-        // The effect is that we can simply pass a pointer to the struct and it translates perfectly to a glm::vec3/2 array which
-        // again translates to 3/2 floats which translates to a byte array.
-        glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(Vertex), &vertices[0], GL_STATIC_DRAW);
-
-        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
-        glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned int), &indices[0], GL_STATIC_DRAW);
-
-        // set the vertex attribute pointers
-        // vertex Positions
-        glEnableVertexAttribArray(0);
-        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)0);
-        // vertex normals
-        glEnableVertexAttribArray(1);
-        glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, Normal));
-        // vertex texture coords
-        glEnableVertexAttribArray(2);
-        glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, TexCoords));
-        // vertex tangent
-        glEnableVertexAttribArray(3);
-        glVertexAttribPointer(3, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, Tangent));
-        // vertex bitangent
-        glEnableVertexAttribArray(4);
-        glVertexAttribPointer(4, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, Bitangent));
-
-        glBindVertexArray(0);
+        // int16 covers the bounding box, flat axes get a scale of 0 and all their positions are the offset
+        positionOffset = (boundsMin + boundsMax) * 0.5f;
+        positionScale = (boundsMax - boundsMin) * 0.5f;
+        const auto quantize = [](float value, float offset, float scale) {
+            const float normalized = scale > 0.0f ? (value - offset) / scale : 0.0f;
+            return static_cast<std::int16_t>(std::lround(std::clamp(normalized, -1.0f, 1.0f) * 32767.0f));
+        };
+
+        std::vector<PackedVertex> packed;
+        packed.reserve(vertices.size());
+        for (const Vertex& vertex : vertices)
+        {
+            PackedVertex& p = packed.emplace_back();
+            for (int i = 0; i < 3; i++)
+                p.Position[i] = quantize(vertex.Position[i], positionOffset[i], positionScale[i]);
+            p.Position[3] = 0;
+            p.Normal = glm::packSnorm3x10_1x2(glm::vec4(vertex.Normal, 0.0f));
+            // w is -1 for mirrored texture coordinates, where the bitangent is -cross(normal, tangent)
+            const float handedness = glm::dot(glm::cross(vertex.Normal, vertex.Tangent), vertex.Bitangent) < 0.0f ? -1.0f : 1.0f;
+            p.Tangent = glm::packSnorm3x10_1x2(glm::vec4(vertex.Tangent, handedness));
+            p.TexCoords = glm::packHalf2x16(vertex.TexCoords);
+        }
+        addToArena(packedVertexFormat, std::as_bytes(std::span<const PackedVertex>(packed)), indices, packed.size());
     }
 };
 
@@ -1,6 +1,8 @@
 //
 // Created by aleksa on 12.4.24..
-// This is an edited version of learnopengl/model.h to support gamma correction and emission mapping
+// This is an edited version of learnopengl/model.h to support gamma correction and emission mapping,
+// textures are decoded in parallel through a TextureLoader and Assimp's output is optimized for the vertex cache
+// and cached in a binary file
 //
 
 #ifndef CYBERPUNK_HALLWAY_MODEL_EDITED_H
@@ -10,14 +12,19 @@
 
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
-#include <stb_image.h>
 #include <assimp/Importer.hpp>
 #include <assimp/scene.h>
 #include <assimp/postprocess.h>
 
 #include <learnopengl/mesh_edited.h>
 #include <learnopengl/shader.h>
+#include <mesh_cache.h>
+#include <mesh_optimizer.h>
+#include <mesh_simplifier.h>
+#include <meshlet_builder.h>
+#include <texture_loader.h>
 
+#include <algorithm>
 #include <string>
 #include <fstream>
 #include <sstream>
@@ -25,58 +32,141 @@
 #include <map>
 #include <vector>
 
-unsigned int TextureFromFile(const char *path, const std::string &directory, const std::string &typeName, bool gamma = false);
-
-
 class Model
 {
 public:
     // model data
-    std::vector<Texture> textures_loaded;	// stores all the textures loaded so far, optimization to make sure textures aren't loaded more than once.
     std::vector<Mesh>    meshes;
     std::string directory;
     bool gammaCorrection;
+    VertexLayout vertexLayout;
+    // object space bounding box of all meshes
+    glm::vec3 boundsMin{0.0f};
+    glm::vec3 boundsMax{0.0f};
+    // per level of detail the largest error of the meshes, level 0 is the full model with no error
+    std::vector<float> lodErrors;
 
     // constructor, expects a filepath to a 3D model.
-    explicit Model(std::string const &path, bool gamma = false) : gammaCorrection(gamma)
+    // the textures are only requested from the loader, they are usable after its finish()
+    // the meshes are suballocated from the arena, which has to outlive the model
+    Model(std::string const &path, TextureLoader &textureLoader, GeometryArena &arena, bool gamma = false, VertexLayout layout = VertexLayout::full)
+        : gammaCorrection(gamma), vertexLayout(layout), textureLoader(&textureLoader), arena(&arena)
     {
         loadModel(path);
+        computeBounds();
+        computeLodErrors();
+        this->textureLoader = nullptr;
+        this->arena = nullptr;
     }
 
-    // draws the model, and thus all its meshes
-    void Draw(Shader &shader)
+private:
+    // only set during construction
+    TextureLoader *textureLoader;
+    GeometryArena *arena;
+
+    void computeBounds()
     {
-        for(auto i = std::ssize(meshes) - 1; i >= 0; --i)
-            meshes[i].Draw(shader);
+        if (meshes.empty())
+            return;
+        boundsMin = meshes.front().boundsMin;
+        boundsMax = meshes.front().boundsMax;
+        for (const Mesh& mesh : meshes) {
+            boundsMin = glm::min(boundsMin, mesh.boundsMin);
+            boundsMax = glm::max(boundsMax, mesh.boundsMax);
+        }
     }
 
-    void SetShaderTextureNamePrefix(std::string prefix) {
-        for (Mesh& mesh: meshes) {
-            mesh.glslIdentifierPrefix = prefix;
-        }
+    // meshes with fewer levels use their coarsest one on the levels they don't have
+    void computeLodErrors()
+    {
+        std::size_t levels = 1;
+        for (const Mesh& mesh : meshes)
+            levels = std::max(levels, mesh.lodCount());
+        lodErrors.assign(levels, 0.0f);
+        for (const Mesh& mesh : meshes)
+            for (std::size_t level = 0; level < levels; level++)
+                lodErrors[level] = std::max(lodErrors[level], mesh.lodError(level));
     }
-private:
+
     // loads a model with supported ASSIMP extensions from file and stores the resulting meshes in the meshes vector.
+    // the meshes are taken from the model's cache file if it is up to date, and the cache is rewritten otherwise
     void loadModel(std::string const &path)
     {
+        constexpr unsigned int postProcessFlags = aiProcess_Triangulate | aiProcess_GenSmoothNormals | aiProcess_FlipUVs | aiProcess_CalcTangentSpace;
+        // retrieve the directory path of the filepath
+        directory = path.substr(0, path.find_last_of('/'));
+
+        const std::uint64_t sourceHash = mesh_cache::source_hash(path);
+        if(sourceHash != 0 && loadCachedModel(path, postProcessFlags, sourceHash))
+            return;
+
         // read file via ASSIMP
         Assimp::Importer importer;
-        const aiScene* scene = importer.ReadFile(path, aiProcess_Triangulate | aiProcess_GenSmoothNormals | aiProcess_FlipUVs | aiProcess_CalcTangentSpace);
+        const aiScene* scene = importer.ReadFile(path, postProcessFlags);
         // check for errors
         if(!scene || scene->mFlags & AI_SCENE_FLAGS_INCOMPLETE || !scene->mRootNode) // if is Not Zero
         {
             std::cout << "ERROR::ASSIMP:: " << importer.GetErrorString() << std::endl;
             return;
         }
-        // retrieve the directory path of the filepath
-        directory = path.substr(0, path.find_last_of('/'));
 
         // process ASSIMP's root node recursively
-        processNode(scene->mRootNode, scene);
+        std::vector<MeshData> meshData;
+        processNode(scene->mRootNode, scene, meshData);
+
+        // reorder for the GPU's caches once, the cache file stores the optimized meshes
+        for(std::size_t i = 0; i < meshData.size(); i++)
+        {
+            const auto [before, after] = mesh_optimizer::optimize(meshData[i].vertices, meshData[i].indices);
+            std::cout << "Optimized mesh " << i << " of " << path << ": ACMR " << before.acmr << " -> " << after.acmr
+                      << ", ATVR " << before.atvr << " -> " << after.atvr << std::endl;
+        }
+        meshData = mesh_optimizer::split_for_short_indices(std::move(meshData));
+
+        // the meshlets and the levels of detail go into the cache as well, simplifying the big meshes takes a while
+        for(std::size_t i = 0; i < meshData.size(); i++)
+        {
+            meshData[i].meshlets = meshlet_builder::build(meshData[i].vertices, meshData[i].indices);
+            meshData[i].lods = mesh_simplifier::generate_lods(meshData[i].vertices, meshData[i].indices);
+            if(meshData[i].lods.empty())
+                continue;
+            std::cout << "Simplified mesh " << i << " of " << path << ": " << meshData[i].indices.size() / 3;
+            for(const MeshLodData& lod : meshData[i].lods)
+                std::cout << " -> " << lod.indices.size() / 3;
+            std::cout << " triangles" << std::endl;
+        }
+
+        if(sourceHash != 0)
+            mesh_cache::write(mesh_cache::cache_path(path), meshData, postProcessFlags, sourceHash);
+
+        // upload the meshes, the CPU copies are freed one by one
+        meshes.reserve(meshData.size());
+        for(auto& data : meshData)
+            meshes.emplace_back(*arena, std::move(data), vertexLayout);
+    }
+
+    // creates the meshes from a mapped cache file, returns false if there is no valid cache for the model
+    bool loadCachedModel(std::string const &path, unsigned int postProcessFlags, std::uint64_t sourceHash)
+    {
+        const mesh_cache::MappedFile file(mesh_cache::cache_path(path));
+        const auto cachedMeshes = mesh_cache::read(file.data(), postProcessFlags, sourceHash);
+        if(!cachedMeshes)
+            return false;
+
+        meshes.reserve(cachedMeshes->size());
+        for(const auto& cachedMesh : *cachedMeshes)
+        {
+            std::vector<Texture> textures;
+            for(const auto& [type, texturePath] : cachedMesh.textures)
+                textures.push_back(loadTexture(std::string(type), std::string(texturePath)));
+            meshes.emplace_back(*arena, cachedMesh.vertices, cachedMesh.indices, cachedMesh.lods, cachedMesh.meshlets, std::move(textures),
+                                vertexLayout);
+        }
+        return true;
     }
 
     // processes a node in a recursive fashion. Processes each individual mesh located at the node and repeats this process on its children nodes (if any).
-    void processNode(aiNode *node, const aiScene *scene)
+    void processNode(aiNode *node, const aiScene *scene, std::vector<MeshData> &meshData)
     {
         // process each mesh located at the current node
         for(unsigned int i = 0; i < node->mNumMeshes; i++)
@@ -84,22 +174,24 @@ private:
             // the node object only contains indices to index the actual objects in the scene.
             // the scene contains all the data, node is just to keep stuff organized (like relations between nodes).
             aiMesh* mesh = scene->mMeshes[node->mMeshes[i]];
-            meshes.push_back(processMesh(mesh, scene));
+            meshData.push_back(processMesh(mesh, scene));
         }
         // after we've processed all of the meshes (if any) we then recursively process each of the children nodes
         for(unsigned int i = 0; i < node->mNumChildren; i++)
         {
-            processNode(node->mChildren[i], scene);
+            processNode(node->mChildren[i], scene, meshData);
         }
 
     }
 
-    Mesh processMesh(aiMesh *mesh, const aiScene *scene)
+    MeshData processMesh(aiMesh *mesh, const aiScene *scene)
     {
         // data to fill
         std::vector<Vertex> vertices;
         std::vector<unsigned int> indices;
         std::vector<Texture> textures;
+        vertices.reserve(mesh->mNumVertices);
+        indices.reserve(std::size_t{mesh->mNumFaces} * 3);
 
         // walk through each of the mesh's vertices
         for(unsigned int i = 0; i < mesh->mNumVertices; i++)
@@ -184,11 +276,11 @@ private:
 
 
 
-        // return a mesh object created from the extracted mesh data
-        return Mesh(vertices, indices, textures);
+        // return the extracted mesh data, it is uploaded once the cache is written
+        return MeshData{std::move(vertices), std::move(indices), std::move(textures), {}, {}};
     }
 
-    // checks all material textures of a given type and loads the textures if they're not loaded yet.
+    // requests all material textures of a given type, the TextureRegistry skips the ones that are already loaded.
     // the required info is returned as a Texture struct.
     std::vector<Texture> loadMaterialTextures(aiMaterial *mat, aiTextureType type, std::string typeName)
     {
@@ -197,86 +289,23 @@ private:
         {
             aiString str;
             mat->GetTexture(type, i, &str);
-            // check if texture was loaded before and if so, continue to next iteration: skip loading a new texture
-            bool skip = false;
-            for(unsigned int j = 0; j < textures_loaded.size(); j++)
-            {
-                if(std::strcmp(textures_loaded[j].path.data(), str.C_Str()) == 0)
-                {
-                    textures.push_back(textures_loaded[j]);
-                    skip = true; // a texture with the same filepath has already been loaded, continue to next one. (optimization)
-                    break;
-                }
-            }
-            if(!skip)
-            {   // if texture hasn't been loaded already, load it
-                Texture texture;
-                texture.id = TextureFromFile(str.C_Str(), this->directory, typeName, gammaCorrection);
-                texture.type = typeName;
-                texture.path = str.C_Str();
-                textures.push_back(texture);
-                textures_loaded.push_back(texture);  // store it as texture loaded for entire model, to ensure we won't unnecesery load duplicate textures.
-            }
+            // loadTexture shares textures that are already loaded, so every material texture is simply requested
+            textures.push_back(loadTexture(typeName, str.C_Str()));
         }
         return textures;
     }
-};
-
-
-unsigned int TextureFromFile(const char *path, const std::string &directory, const std::string& typeName, bool gamma)
-{
-    std::string filename = std::string(path);
-    filename = directory + '/' + filename;
-
-    unsigned int textureID;
-    glGenTextures(1, &textureID);
-
-    int width, height, nrComponents;
-    unsigned char *data = stbi_load(filename.c_str(), &width, &height, &nrComponents, 0);
-    if (data)
-    {
-        GLint format1, format2;
-        if (nrComponents == 1) {
-            format1 = GL_RED;
-            format2 = GL_RED;
-        }
-        else if (nrComponents == 3) {
-            if (gamma && typeName == "texture_diffuse") {
-                format1 = GL_SRGB;
-            }
-            else {
-                format1 = GL_RGB;
-            }
-            format2 = GL_RGB;
-        }
-        else if (nrComponents == 4) {
-            if (gamma && typeName == "texture_diffuse") {
-                format1 = GL_SRGB_ALPHA;
-            }
-            else {
-                format1 = GL_RGBA;
-            }
-            format2 = GL_RGBA;
-        }
-
-        glBindTexture(GL_TEXTURE_2D, textureID);
-        glTexImage2D(GL_TEXTURE_2D, 0, format1, width, height, 0, format2, GL_UNSIGNED_BYTE, data);
-        glGenerateMipmap(GL_TEXTURE_2D);
-
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
 
-        stbi_image_free(data);
-    }
-    else
+    // requests a texture from the loader, textures loaded before by any model are shared through the TextureRegistry
+    Texture loadTexture(const std::string &typeName, const std::string &path)
     {
-        std::cout << "Texture failed to load at path: " << path << std::endl;
-        stbi_image_free(data);
+        Texture texture;
+        TextureLoader::Options options;
+        options.gamma_correction = gammaCorrection && typeName == "texture_diffuse";
+        texture.handle = textureLoader->load(this->directory + '/' + path, options);
+        texture.type = typeName;
+        texture.path = path;
+        return texture;
     }
-
-    return textureID;
-}
+};
 
 #endif //CYBERPUNK_HALLWAY_MODEL_EDITED_H
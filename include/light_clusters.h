@@ -0,0 +1,254 @@
+//
+// Clustered forward lighting: the view frustum is split into a grid of clusters (screen tiles x exponential depth
+// slices) and every frame each light is assigned to the clusters its sphere of influence touches. The lighting shaders
+// then loop only over the lights of the fragment's cluster. Everything is done on the CPU and handed to the shaders
+// through two texture buffers, so it works on a GL 3.3 context without compute shaders.
+//
+
+#ifndef CYBERPUNK_HALLWAY_LIGHT_CLUSTERS_H
+#define CYBERPUNK_HALLWAY_LIGHT_CLUSTERS_H
+
+#include <glad/glad.h>
+
+#include <glm/glm.hpp>
+
+#include <lights.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <vector>
+
+class LightClusters
+{
+public:
+    static constexpr int tiles_x = 16;
+    static constexpr int tiles_y = 9;
+    static constexpr int slices = 24;
+    static constexpr int cluster_count = tiles_x * tiles_y * slices;
+    // texture units the shaders' lightGrid and lightIndices samplers are bound to
+    static constexpr int grid_texture_unit = 8;
+    static constexpr int indices_texture_unit = 9;
+
+    LightClusters()
+        : m_cluster_lights(static_cast<std::size_t>(cluster_count) * max_lights),
+          m_cluster_sizes(cluster_count),
+          m_grid(2 * static_cast<std::size_t>(cluster_count))
+    {
+        GLint max_texels{};
+        glGetIntegerv(GL_MAX_TEXTURE_BUFFER_SIZE, &max_texels);
+        m_max_indices = static_cast<std::size_t>(max_texels);
+
+        glGenBuffers(1, &m_grid_buffer);
+        glBindBuffer(GL_TEXTURE_BUFFER, m_grid_buffer);
+        glBufferData(GL_TEXTURE_BUFFER, static_cast<GLsizeiptr>(m_grid.size() * sizeof(std::uint32_t)), nullptr, GL_STREAM_DRAW);
+        glGenBuffers(1, &m_indices_buffer);
+        glBindBuffer(GL_TEXTURE_BUFFER, m_indices_buffer);
+        glBufferData(GL_TEXTURE_BUFFER, sizeof(std::uint16_t), nullptr, GL_STREAM_DRAW);
+        glBindBuffer(GL_TEXTURE_BUFFER, 0);
+
+        glGenTextures(1, &m_grid_texture);
+        glBindTexture(GL_TEXTURE_BUFFER, m_grid_texture);
+        glTexBuffer(GL_TEXTURE_BUFFER, GL_RG32UI, m_grid_buffer);
+        glGenTextures(1, &m_indices_texture);
+        glBindTexture(GL_TEXTURE_BUFFER, m_indices_texture);
+        glTexBuffer(GL_TEXTURE_BUFFER, GL_R16UI, m_indices_buffer);
+        glBindTexture(GL_TEXTURE_BUFFER, 0);
+    }
+
+    LightClusters(const LightClusters&) = delete;
+    LightClusters& operator=(const LightClusters&) = delete;
+
+    ~LightClusters()
+    {
+        glDeleteTextures(1, &m_grid_texture);
+        glDeleteTextures(1, &m_indices_texture);
+        glDeleteBuffers(1, &m_grid_buffer);
+        glDeleteBuffers(1, &m_indices_buffer);
+    }
+
+    // assigns the lights to clusters and uploads the result, projection must be a perspective projection
+    // with the given near and far planes
+    void update(const Light* lights, std::size_t light_count, const glm::mat4& view, const glm::mat4& projection,
+                float z_near, float z_far)
+    {
+        if (projection != m_projection || z_near != m_near || z_far != m_far) {
+            m_projection = projection;
+            m_near = z_near;
+            m_far = z_far;
+            compute_cluster_bounds();
+        }
+
+        std::fill(m_cluster_sizes.begin(), m_cluster_sizes.end(), 0);
+        for (std::size_t i = 0; i < std::min(light_count, max_lights); i++) {
+            assign_light(static_cast<std::uint16_t>(i), lights[i], view);
+        }
+
+        // compact the per-cluster lists into one index list
+        m_indices.clear();
+        for (int cluster = 0; cluster < cluster_count; cluster++) {
+            const auto offset = m_indices.size();
+            const auto size = std::min<std::size_t>(m_cluster_sizes[cluster], m_max_indices - offset);
+            const auto first = m_cluster_lights.begin() + static_cast<std::ptrdiff_t>(cluster * max_lights);
+            m_indices.insert(m_indices.end(), first, first + static_cast<std::ptrdiff_t>(size));
+            m_grid[2 * cluster] = static_cast<std::uint32_t>(offset);
+            m_grid[2 * cluster + 1] = static_cast<std::uint32_t>(size);
+        }
+        if (m_indices.empty()) {
+            m_indices.push_back(0);
+        }
+
+        glBindBuffer(GL_TEXTURE_BUFFER, m_grid_buffer);
+        glBufferSubData(GL_TEXTURE_BUFFER, 0, static_cast<GLsizeiptr>(m_grid.size() * sizeof(std::uint32_t)), m_grid.data());
+        glBindBuffer(GL_TEXTURE_BUFFER, m_indices_buffer);
+        glBufferData(GL_TEXTURE_BUFFER, static_cast<GLsizeiptr>(m_indices.size() * sizeof(std::uint16_t)), m_indices.data(), GL_STREAM_DRAW);
+        glBindBuffer(GL_TEXTURE_BUFFER, 0);
+    }
+
+    void bind() const
+    {
+        glActiveTexture(GL_TEXTURE0 + grid_texture_unit);
+        glBindTexture(GL_TEXTURE_BUFFER, m_grid_texture);
+        glActiveTexture(GL_TEXTURE0 + indices_texture_unit);
+        glBindTexture(GL_TEXTURE_BUFFER, m_indices_texture);
+        glActiveTexture(GL_TEXTURE0);
+    }
+
+    // values of clusterScale in the Frame uniform block for a viewport of the given size:
+    // tiles per pixel in x and y, and the scale and bias that map log(view depth) to a depth slice
+    [[nodiscard]] glm::vec4 shader_scale(int viewport_width, int viewport_height) const
+    {
+        const float log_depth_range = std::log(m_far / m_near);
+        return {static_cast<float>(tiles_x) / static_cast<float>(viewport_width),
+                static_cast<float>(tiles_y) / static_cast<float>(viewport_height),
+                static_cast<float>(slices) / log_depth_range,
+                -static_cast<float>(slices) * std::log(m_near) / log_depth_range};
+    }
+
+    // number of light-cluster pairs in the last update
+    [[nodiscard]] std::size_t assigned_lights() const
+    {
+        return m_indices.size();
+    }
+
+private:
+    struct Bounds
+    {
+        glm::vec3 min;
+        glm::vec3 max;
+    };
+
+    static int cluster_index(int x, int y, int z)
+    {
+        return x + tiles_x * (y + tiles_y * z);
+    }
+
+    [[nodiscard]] float slice_depth(int slice) const
+    {
+        return m_near * std::pow(m_far / m_near, static_cast<float>(slice) / static_cast<float>(slices));
+    }
+
+    [[nodiscard]] int depth_slice(float depth) const
+    {
+        const auto slice = static_cast<int>(std::floor(std::log(depth / m_near) / std::log(m_far / m_near) * static_cast<float>(slices)));
+        return std::clamp(slice, 0, slices - 1);
+    }
+
+    // view space bounding boxes of all clusters
+    void compute_cluster_bounds()
+    {
+        m_bounds.resize(cluster_count);
+        for (int z = 0; z < slices; z++) {
+            const float depths[] {slice_depth(z), slice_depth(z + 1)};
+            for (int y = 0; y < tiles_y; y++) {
+                for (int x = 0; x < tiles_x; x++) {
+                    const glm::vec2 ndc_min{2.0f * static_cast<float>(x) / tiles_x - 1.0f, 2.0f * static_cast<float>(y) / tiles_y - 1.0f};
+                    const glm::vec2 ndc_max{2.0f * static_cast<float>(x + 1) / tiles_x - 1.0f, 2.0f * static_cast<float>(y + 1) / tiles_y - 1.0f};
+                    Bounds bounds{glm::vec3{std::numeric_limits<float>::max()}, glm::vec3{-std::numeric_limits<float>::max()}};
+                    for (const float depth : depths) {
+                        for (const glm::vec2 ndc : {ndc_min, ndc_max}) {
+                            const glm::vec3 corner{ndc.x * depth / m_projection[0][0], ndc.y * depth / m_projection[1][1], -depth};
+                            bounds.min = glm::min(bounds.min, corner);
+                            bounds.max = glm::max(bounds.max, corner);
+                        }
+                    }
+                    m_bounds[cluster_index(x, y, z)] = bounds;
+                }
+            }
+        }
+    }
+
+    void assign_light(std::uint16_t index, const Light& light, const glm::mat4& view)
+    {
+        const float radius = light.radius;
+        if (radius <= 0.0f) {
+            return;
+        }
+        const glm::vec3 center = glm::vec3(view * glm::vec4(light.position, 1.0f));
+        const float depth = -center.z;
+        if (depth + radius < m_near || depth - radius > m_far) {
+            return;
+        }
+
+        // screen rectangle covered by the light, the whole screen if the sphere crosses the near plane
+        int tile_min_x = 0, tile_max_x = tiles_x - 1;
+        int tile_min_y = 0, tile_max_y = tiles_y - 1;
+        if (depth - radius > m_near) {
+            glm::vec2 ndc_min{std::numeric_limits<float>::max()};
+            glm::vec2 ndc_max{-std::numeric_limits<float>::max()};
+            for (const float dz : {-radius, radius}) {
+                for (const float dy : {-radius, radius}) {
+                    for (const float dx : {-radius, radius}) {
+                        const glm::vec3 corner = center + glm::vec3{dx, dy, dz};
+                        const glm::vec2 ndc{m_projection[0][0] * corner.x / -corner.z, m_projection[1][1] * corner.y / -corner.z};
+                        ndc_min = glm::min(ndc_min, ndc);
+                        ndc_max = glm::max(ndc_max, ndc);
+                    }
+                }
+            }
+            if (ndc_max.x < -1.0f || ndc_min.x > 1.0f || ndc_max.y < -1.0f || ndc_min.y > 1.0f) {
+                return;
+            }
+            tile_min_x = std::clamp(static_cast<int>((ndc_min.x * 0.5f + 0.5f) * tiles_x), 0, tiles_x - 1);
+            tile_max_x = std::clamp(static_cast<int>((ndc_max.x * 0.5f + 0.5f) * tiles_x), 0, tiles_x - 1);
+            tile_min_y = std::clamp(static_cast<int>((ndc_min.y * 0.5f + 0.5f) * tiles_y), 0, tiles_y - 1);
+            tile_max_y = std::clamp(static_cast<int>((ndc_max.y * 0.5f + 0.5f) * tiles_y), 0, tiles_y - 1);
+        }
+
+        const int slice_min = depth_slice(std::max(depth - radius, m_near));
+        const int slice_max = depth_slice(std::min(depth + radius, m_far));
+        for (int z = slice_min; z <= slice_max; z++) {
+            for (int y = tile_min_y; y <= tile_max_y; y++) {
+                for (int x = tile_min_x; x <= tile_max_x; x++) {
+                    const int cluster = cluster_index(x, y, z);
+                    const Bounds& bounds = m_bounds[cluster];
+                    const glm::vec3 closest = glm::clamp(center, bounds.min, bounds.max);
+                    const glm::vec3 offset = closest - center;
+                    if (glm::dot(offset, offset) <= radius * radius) {
+                        m_cluster_lights[cluster * max_lights + m_cluster_sizes[cluster]++] = index;
+                    }
+                }
+            }
+        }
+    }
+
+    glm::mat4 m_projection{0.0f};
+    float m_near{};
+    float m_far{};
+    std::vector<Bounds> m_bounds;
+    // light lists of every cluster, max_lights entries reserved for each
+    std::vector<std::uint16_t> m_cluster_lights;
+    std::vector<std::uint32_t> m_cluster_sizes;
+    // (offset, count) of every cluster's range in m_indices
+    std::vector<std::uint32_t> m_grid;
+    std::vector<std::uint16_t> m_indices;
+    std::size_t m_max_indices{};
+
+    unsigned m_grid_buffer{};
+    unsigned m_indices_buffer{};
+    unsigned m_grid_texture{};
+    unsigned m_indices_texture{};
+};
+
+#endif //CYBERPUNK_HALLWAY_LIGHT_CLUSTERS_H
@@ -0,0 +1,76 @@
+//
+// Point lights as seen by the lighting shaders
+//
+
+#ifndef CYBERPUNK_HALLWAY_LIGHTS_H
+#define CYBERPUNK_HALLWAY_LIGHTS_H
+
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <limits>
+
+// must match MAX_LIGHTS in the shaders, 256 lights fill the minimal guaranteed uniform block size of 16 KB
+constexpr std::size_t max_lights = 256;
+
+// std140 layout of the Light struct in the shaders
+struct Light
+{
+    glm::vec3 position;
+    float constant;
+    glm::vec3 ambient;
+    float linear;
+    glm::vec3 diffuse;
+    float quadratic;
+    glm::vec3 specular;
+    // distance at which the light's contribution falls under the cutoff, the light is culled beyond it
+    float radius;
+};
+static_assert(sizeof(Light) == 64, "Light must match the std140 layout");
+
+struct LightColor
+{
+    glm::vec3 ambient;
+    glm::vec3 diffuse;
+    glm::vec3 specular;
+};
+
+struct Attenuation
+{
+    float constant;
+    float linear;
+    float quadratic;
+};
+
+// distance at which a light of the given intensity attenuates below cutoff,
+// solves intensity / (constant + linear * d + quadratic * d^2) = cutoff for d
+inline float light_radius(float intensity, const Attenuation& attenuation, float cutoff)
+{
+    const float c = attenuation.constant - intensity / cutoff;
+    if (c >= 0.0f) {
+        return 0.0f;
+    }
+    if (attenuation.quadratic > 0.0f) {
+        const float discriminant = attenuation.linear * attenuation.linear - 4.0f * attenuation.quadratic * c;
+        return (-attenuation.linear + std::sqrt(discriminant)) / (2.0f * attenuation.quadratic);
+    }
+    if (attenuation.linear > 0.0f) {
+        return -c / attenuation.linear;
+    }
+    return std::numeric_limits<float>::max();
+}
+
+// cutoff is the smallest contribution of the light (in HDR color units) that is still shaded
+inline Light make_light(const glm::vec3& position, const LightColor& color, const Attenuation& attenuation, float cutoff)
+{
+    const glm::vec3 brightest = color.ambient + color.diffuse + color.specular;
+    const float intensity = std::max({brightest.r, brightest.g, brightest.b});
+    return Light{position, attenuation.constant,
+                 color.ambient, attenuation.linear,
+                 color.diffuse, attenuation.quadratic,
+                 color.specular, light_radius(intensity, attenuation, cutoff)};
+}
+
+#endif //CYBERPUNK_HALLWAY_LIGHTS_H
@@ -0,0 +1,70 @@
+//
+// Level of detail selection: an object is drawn with the coarsest level of its model whose simplification
+// error, projected to the screen at the object's distance, stays below a threshold in pixels. An object moves
+// to a finer level as soon as its level gets too coarse, but to a coarser one only once that one is clearly
+// below the threshold, so objects around a switching distance don't flicker between two levels.
+//
+
+#ifndef CYBERPUNK_HALLWAY_LOD_SELECTOR_H
+#define CYBERPUNK_HALLWAY_LOD_SELECTOR_H
+
+#include <glm/glm.hpp>
+
+#include <frustum.h>
+#include <learnopengl/model_edited.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+
+class LodSelector
+{
+public:
+    // vertical_fov in radians. A coarser level is only chosen if its error stays below (1 - hysteresis) times
+    // the threshold.
+    void begin_frame(const glm::vec3& camera_position, float vertical_fov, int viewport_height, float threshold_pixels,
+                     float hysteresis = 0.25f)
+    {
+        m_camera_position = camera_position;
+        m_pixels_per_unit = static_cast<float>(viewport_height) / (2.0f * std::tan(vertical_fov / 2.0f));
+        m_threshold = threshold_pixels;
+        m_coarsen_threshold = threshold_pixels * (1.0f - hysteresis);
+    }
+
+    // the object's level for this frame, given its level in the last one
+    [[nodiscard]] std::uint8_t select(const Model& model, const glm::mat4& transform, std::uint8_t level) const
+    {
+        if (model.lodErrors.size() < 2) {
+            return 0;
+        }
+        const BoundingBox bounds = BoundingBox{model.boundsMin, model.boundsMax}.transformed(transform);
+        const glm::vec3 nearest = glm::clamp(m_camera_position, bounds.min, bounds.max);
+        const float distance = std::max(glm::length(nearest - m_camera_position), min_distance);
+        const float scale = std::max({glm::length(glm::vec3{transform[0]}), glm::length(glm::vec3{transform[1]}),
+                                      glm::length(glm::vec3{transform[2]})});
+        const auto pixels = [&](std::size_t level) {
+            return model.lodErrors[level] * scale / distance * m_pixels_per_unit;
+        };
+
+        std::size_t selected = std::min<std::size_t>(level, model.lodErrors.size() - 1);
+        while (selected > 0 && pixels(selected) > m_threshold) {
+            selected--;
+        }
+        while (selected + 1 < model.lodErrors.size() && pixels(selected + 1) <= m_coarsen_threshold) {
+            selected++;
+        }
+        return static_cast<std::uint8_t>(selected);
+    }
+
+private:
+    // closer objects, and the camera inside an object's bounds, count as this far away
+    static constexpr float min_distance = 0.01f;
+
+    glm::vec3 m_camera_position{0.0f};
+    float m_pixels_per_unit{1.0f};
+    float m_threshold{1.0f};
+    float m_coarsen_threshold{1.0f};
+};
+
+#endif //CYBERPUNK_HALLWAY_LOD_SELECTOR_H
@@ -0,0 +1,23 @@
+//
+// The textures of a draw by texture unit. Every program's samplers point at the fixed units, so drawing with
+// a material is binding its textures.
+//
+
+#ifndef CYBERPUNK_HALLWAY_MATERIAL_H
+#define CYBERPUNK_HALLWAY_MATERIAL_H
+
+#include <array>
+
+// textures of a draw by texture unit, 0 for none
+struct Material
+{
+    enum Unit { diffuse, specular, normal, height, emission, unit_count };
+    static constexpr std::array<const char*, unit_count> sampler_names{
+        "texture_diffuse1", "texture_specular1", "texture_normal1", "texture_height1", "texture_emission1"};
+
+    std::array<unsigned, unit_count> textures{};
+
+    bool operator==(const Material&) const = default;
+};
+
+#endif //CYBERPUNK_HALLWAY_MATERIAL_H
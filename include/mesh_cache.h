@@ -0,0 +1,316 @@
+//
+// Binary cache of the meshes Assimp produces for a model file. A cache file stores the vertex and index
+// blobs of every mesh, the index blobs of its levels of detail, its meshlets and the material textures they
+// reference, and is only used when its version, the post-processing flags and the hash of the source files
+// all match. Cache files are memory mapped, so the blobs go straight from the page cache into glBufferData.
+//
+// Layout, all fields little endian and 4 byte aligned:
+//   FileHeader
+//   per mesh: MeshHeader, vertex_count Vertex, index_count uint32,
+//             lod_count times (LodHeader, index_count uint32), meshlet_count Meshlet,
+//             texture_count times (TextureHeader, type characters, path characters, padding to 4 bytes)
+//
+
+#ifndef CYBERPUNK_HALLWAY_MESH_CACHE_H
+#define CYBERPUNK_HALLWAY_MESH_CACHE_H
+
+#include <learnopengl/mesh_edited.h>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <optional>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace mesh_cache {
+
+// bump when the file layout, Vertex, the mesh optimization or the simplification changes
+constexpr std::uint32_t version = 5;
+constexpr char magic[8] = {'C', 'H', 'M', 'E', 'S', 'H', '\0', '\0'};
+
+struct FileHeader
+{
+    char magic[8];
+    std::uint32_t version;
+    std::uint32_t vertex_size;
+    std::uint32_t post_process_flags;
+    std::uint32_t mesh_count;
+    std::uint64_t source_hash;
+};
+
+struct MeshHeader
+{
+    std::uint32_t vertex_count;
+    std::uint32_t index_count;
+    std::uint32_t texture_count;
+    std::uint32_t lod_count;
+    std::uint32_t meshlet_count;
+};
+
+struct LodHeader
+{
+    std::uint32_t index_count;
+    float error;
+};
+
+struct TextureHeader
+{
+    std::uint32_t type_length;
+    std::uint32_t path_length;
+};
+
+// a mesh as stored in a mapped cache file, the spans point into the mapping
+struct CachedMesh
+{
+    std::span<const Vertex> vertices;
+    std::span<const std::uint32_t> indices;
+    std::vector<MeshLodView> lods;
+    std::span<const Meshlet> meshlets;
+    // (type, path relative to the model's directory)
+    std::vector<std::pair<std::string_view, std::string_view>> textures;
+};
+
+inline std::uint64_t fnv1a(std::span<const char> data, std::uint64_t hash = 0xcbf29ce484222325ull)
+{
+    for (const char c : data) {
+        hash ^= static_cast<unsigned char>(c);
+        hash *= 0x100000001b3ull;
+    }
+    return hash;
+}
+
+// hash of the model file and the material libraries next to it, 0 if the model can't be read
+inline std::uint64_t source_hash(const std::string& model_path)
+{
+    namespace fs = std::filesystem;
+    std::vector<fs::path> sources{model_path};
+    std::error_code error;
+    for (const auto& entry : fs::directory_iterator(fs::path(model_path).parent_path(), error)) {
+        if (entry.path().extension() == ".mtl") {
+            sources.push_back(entry.path());
+        }
+    }
+    std::sort(sources.begin() + 1, sources.end());
+
+    std::uint64_t hash = 0xcbf29ce484222325ull;
+    std::vector<char> buffer(1 << 16);
+    for (const auto& source : sources) {
+        std::ifstream file(source, std::ios::binary);
+        if (!file) {
+            return 0;
+        }
+        hash = fnv1a(source.filename().string(), hash);
+        while (file.read(buffer.data(), static_cast<std::streamsize>(buffer.size())) || file.gcount() > 0) {
+            hash = fnv1a({buffer.data(), static_cast<std::size_t>(file.gcount())}, hash);
+        }
+    }
+    return hash;
+}
+
+inline std::string cache_path(const std::string& model_path)
+{
+    return model_path + ".meshcache";
+}
+
+// read-only memory mapping of a whole file
+class MappedFile
+{
+public:
+    explicit MappedFile(const std::string& path)
+    {
+        const int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0) {
+            return;
+        }
+        struct stat info{};
+        if (::fstat(fd, &info) == 0 && info.st_size > 0) {
+            void* data = ::mmap(nullptr, static_cast<std::size_t>(info.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+            if (data != MAP_FAILED) {
+                m_data = static_cast<const char*>(data);
+                m_size = static_cast<std::size_t>(info.st_size);
+            }
+        }
+        ::close(fd);
+    }
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    ~MappedFile()
+    {
+        if (m_data) {
+            ::munmap(const_cast<char*>(m_data), m_size);
+        }
+    }
+
+    [[nodiscard]] std::span<const char> data() const
+    {
+        return {m_data, m_size};
+    }
+
+private:
+    const char* m_data{};
+    std::size_t m_size{};
+};
+
+// a corrupted cache must not make the GPU read past the vertex buffer
+inline bool indices_in_range(std::span<const std::uint32_t> indices, std::uint32_t vertex_count)
+{
+    return std::all_of(indices.begin(), indices.end(), [&](std::uint32_t index) { return index < vertex_count; });
+}
+
+// parses a mapped cache file, nothing if it is missing, stale or malformed
+inline std::optional<std::vector<CachedMesh>> read(std::span<const char> file, std::uint32_t post_process_flags, std::uint64_t hash)
+{
+    std::size_t offset = 0;
+    const auto take = [&](std::size_t size) -> const char* {
+        // offset can pass the end of a truncated file, it advances by the padded size
+        if (offset > file.size() || size > file.size() - offset) {
+            return nullptr;
+        }
+        const char* data = file.data() + offset;
+        offset += (size + 3) & ~std::size_t{3};
+        return data;
+    };
+
+    FileHeader header{};
+    const char* header_data = take(sizeof(header));
+    if (!header_data) {
+        return std::nullopt;
+    }
+    std::memcpy(&header, header_data, sizeof(header));
+    if (std::memcmp(header.magic, magic, sizeof(magic)) != 0 || header.version != version ||
+        header.vertex_size != sizeof(Vertex) || header.post_process_flags != post_process_flags || header.source_hash != hash) {
+        return std::nullopt;
+    }
+
+    std::vector<CachedMesh> meshes(header.mesh_count);
+    for (auto& mesh : meshes) {
+        MeshHeader mesh_header{};
+        const char* mesh_header_data = take(sizeof(mesh_header));
+        if (!mesh_header_data) {
+            return std::nullopt;
+        }
+        std::memcpy(&mesh_header, mesh_header_data, sizeof(mesh_header));
+        const char* vertices = take(std::size_t{mesh_header.vertex_count} * sizeof(Vertex));
+        const char* indices = take(std::size_t{mesh_header.index_count} * sizeof(std::uint32_t));
+        if (!vertices || !indices) {
+            return std::nullopt;
+        }
+        // the mapping is page aligned and every record is 4 byte aligned, as are Vertex, uint32 and Meshlet
+        mesh.vertices = {reinterpret_cast<const Vertex*>(vertices), mesh_header.vertex_count};
+        mesh.indices = {reinterpret_cast<const std::uint32_t*>(indices), mesh_header.index_count};
+        if (!indices_in_range(mesh.indices, mesh_header.vertex_count)) {
+            return std::nullopt;
+        }
+        for (std::uint32_t i = 0; i < mesh_header.lod_count; i++) {
+            LodHeader lod{};
+            const char* lod_data = take(sizeof(lod));
+            if (!lod_data) {
+                return std::nullopt;
+            }
+            std::memcpy(&lod, lod_data, sizeof(lod));
+            const char* lod_indices = take(std::size_t{lod.index_count} * sizeof(std::uint32_t));
+            if (!lod_indices) {
+                return std::nullopt;
+            }
+            mesh.lods.push_back({{reinterpret_cast<const std::uint32_t*>(lod_indices), lod.index_count}, lod.error});
+            if (!indices_in_range(mesh.lods.back().indices, mesh_header.vertex_count)) {
+                return std::nullopt;
+            }
+        }
+        const char* meshlets = take(std::size_t{mesh_header.meshlet_count} * sizeof(Meshlet));
+        if (!meshlets) {
+            return std::nullopt;
+        }
+        mesh.meshlets = {reinterpret_cast<const Meshlet*>(meshlets), mesh_header.meshlet_count};
+        for (const Meshlet& meshlet : mesh.meshlets) {
+            if (meshlet.firstIndex > mesh_header.index_count || meshlet.indexCount > mesh_header.index_count - meshlet.firstIndex) {
+                return std::nullopt;
+            }
+        }
+        for (std::uint32_t i = 0; i < mesh_header.texture_count; i++) {
+            TextureHeader texture{};
+            const char* texture_data = take(sizeof(texture));
+            if (!texture_data) {
+                return std::nullopt;
+            }
+            std::memcpy(&texture, texture_data, sizeof(texture));
+            const char* strings = take(std::size_t{texture.type_length} + texture.path_length);
+            if (!strings) {
+                return std::nullopt;
+            }
+            mesh.textures.emplace_back(std::string_view{strings, texture.type_length},
+                                       std::string_view{strings + texture.type_length, texture.path_length});
+        }
+    }
+    return meshes;
+}
+
+// writes the cache through a temporary file, so a crash never leaves a truncated cache behind.
+// Failing to write is not an error, the model is just parsed again next time.
+inline void write(const std::string& path, const std::vector<MeshData>& meshes, std::uint32_t post_process_flags, std::uint64_t hash)
+{
+    const std::string temporary = path + ".tmp";
+    {
+        std::ofstream file(temporary, std::ios::binary | std::ios::trunc);
+        if (!file) {
+            return;
+        }
+        const auto put = [&](const void* data, std::size_t size) {
+            static constexpr char padding[4]{};
+            file.write(static_cast<const char*>(data), static_cast<std::streamsize>(size));
+            file.write(padding, static_cast<std::streamsize>(((size + 3) & ~std::size_t{3}) - size));
+        };
+
+        FileHeader header{};
+        std::memcpy(header.magic, magic, sizeof(magic));
+        header.version = version;
+        header.vertex_size = sizeof(Vertex);
+        header.post_process_flags = post_process_flags;
+        header.mesh_count = static_cast<std::uint32_t>(meshes.size());
+        header.source_hash = hash;
+        put(&header, sizeof(header));
+
+        for (const auto& mesh : meshes) {
+            const MeshHeader mesh_header{static_cast<std::uint32_t>(mesh.vertices.size()), static_cast<std::uint32_t>(mesh.indices.size()),
+                                         static_cast<std::uint32_t>(mesh.textures.size()), static_cast<std::uint32_t>(mesh.lods.size()),
+                                         static_cast<std::uint32_t>(mesh.meshlets.size())};
+            put(&mesh_header, sizeof(mesh_header));
+            put(mesh.vertices.data(), mesh.vertices.size() * sizeof(Vertex));
+            put(mesh.indices.data(), mesh.indices.size() * sizeof(std::uint32_t));
+            for (const auto& lod : mesh.lods) {
+                const LodHeader lod_header{static_cast<std::uint32_t>(lod.indices.size()), lod.error};
+                put(&lod_header, sizeof(lod_header));
+                put(lod.indices.data(), lod.indices.size() * sizeof(std::uint32_t));
+            }
+            put(mesh.meshlets.data(), mesh.meshlets.size() * sizeof(Meshlet));
+            for (const auto& texture : mesh.textures) {
+                const TextureHeader texture_header{static_cast<std::uint32_t>(texture.type.size()), static_cast<std::uint32_t>(texture.path.size())};
+                put(&texture_header, sizeof(texture_header));
+                put((texture.type + texture.path).data(), texture.type.size() + texture.path.size());
+            }
+        }
+        if (!file) {
+            file.close();
+            std::filesystem::remove(temporary);
+            return;
+        }
+    }
+    std::error_code error;
+    std::filesystem::rename(temporary, path, error);
+}
+
+} // namespace mesh_cache
+
+#endif //CYBERPUNK_HALLWAY_MESH_CACHE_H
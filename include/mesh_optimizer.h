@@ -0,0 +1,346 @@
+//
+// Reorders the triangles and vertices of a mesh for the GPU: triangles for post-transform vertex cache hits
+// (Tom Forsyth's linear-speed vertex cache optimization), then runs of triangles for less overdraw, and
+// finally the vertices in the order the triangles first use them, for vertex fetch locality. Meshes too large
+// for 16 bit indices are split.
+// The cost is reported as ACMR (transformed vertices per triangle) and ATVR (transformed vertices per vertex,
+// 1 is ideal) from a simulated FIFO cache.
+//
+
+#ifndef CYBERPUNK_HALLWAY_MESH_OPTIMIZER_H
+#define CYBERPUNK_HALLWAY_MESH_OPTIMIZER_H
+
+#include <learnopengl/mesh_edited.h>
+
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <numeric>
+#include <vector>
+
+namespace mesh_optimizer {
+
+// size of the simulated post-transform cache, both for the optimization and the statistics
+constexpr std::size_t cache_size = 32;
+
+struct CacheStatistics
+{
+    // average cache miss ratio, 0.5 is about the best a regular grid allows and 3 the worst
+    float acmr{};
+    // average transformed vertex ratio, 1 when every vertex is transformed exactly once
+    float atvr{};
+};
+
+// simulates a FIFO cache over the index buffer
+inline CacheStatistics analyze(const std::vector<unsigned int>& indices, std::size_t vertex_count)
+{
+    if (indices.empty() || vertex_count == 0) {
+        return {};
+    }
+    // a vertex is cached while fewer than cache_size misses happened since it was inserted
+    std::vector<std::size_t> inserted(vertex_count, 0);
+    std::size_t misses = 0;
+    for (const unsigned int index : indices) {
+        if (inserted[index] == 0 || misses - inserted[index] + 1 > cache_size) {
+            misses++;
+            inserted[index] = misses;
+        }
+    }
+    return {static_cast<float>(misses) / static_cast<float>(indices.size() / 3),
+            static_cast<float>(misses) / static_cast<float>(vertex_count)};
+}
+
+namespace detail {
+
+// Forsyth's vertex score: vertices in the cache score higher the more recently they were used, the three of
+// the last triangle a fixed amount, and vertices with few remaining triangles get a boost so they are finished
+inline float vertex_score(int cache_position, std::uint32_t remaining_triangles)
+{
+    if (remaining_triangles == 0) {
+        return -1.0f;
+    }
+    constexpr float cache_decay_power = 1.5f;
+    constexpr float last_triangle_score = 0.75f;
+    constexpr float valence_boost_scale = 2.0f;
+    constexpr float valence_boost_power = 0.5f;
+
+    float score = 0.0f;
+    if (cache_position >= 0) {
+        if (cache_position < 3) {
+            score = last_triangle_score;
+        } else {
+            const float scaler = 1.0f / static_cast<float>(cache_size - 3);
+            score = std::pow(1.0f - static_cast<float>(cache_position - 3) * scaler, cache_decay_power);
+        }
+    }
+    return score + valence_boost_scale * std::pow(static_cast<float>(remaining_triangles), -valence_boost_power);
+}
+
+} // namespace detail
+
+// reorders the triangles for vertex cache hits
+inline void optimize_vertex_cache(std::vector<unsigned int>& indices, std::size_t vertex_count)
+{
+    const std::size_t triangle_count = indices.size() / 3;
+    if (triangle_count == 0) {
+        return;
+    }
+
+    // triangles of every vertex, as offsets into one array
+    std::vector<std::uint32_t> remaining(vertex_count, 0);
+    for (const unsigned int index : indices) {
+        remaining[index]++;
+    }
+    std::vector<std::uint32_t> offsets(vertex_count + 1, 0);
+    std::partial_sum(remaining.begin(), remaining.end(), offsets.begin() + 1);
+    std::vector<std::uint32_t> vertex_triangles(indices.size());
+    {
+        std::vector<std::uint32_t> fill(offsets.begin(), offsets.end() - 1);
+        for (std::size_t i = 0; i < indices.size(); i++) {
+            vertex_triangles[fill[indices[i]]++] = static_cast<std::uint32_t>(i / 3);
+        }
+    }
+
+    std::vector<int> cache_position(vertex_count, -1);
+    std::vector<float> vertex_scores(vertex_count);
+    for (std::size_t v = 0; v < vertex_count; v++) {
+        vertex_scores[v] = detail::vertex_score(-1, remaining[v]);
+    }
+    std::vector<float> triangle_scores(triangle_count);
+    for (std::size_t t = 0; t < triangle_count; t++) {
+        triangle_scores[t] = vertex_scores[indices[3 * t]] + vertex_scores[indices[3 * t + 1]] + vertex_scores[indices[3 * t + 2]];
+    }
+    std::vector<bool> emitted(triangle_count, false);
+
+    // the cache holds up to 3 extra entries while a triangle is added
+    std::vector<unsigned int> cache;
+    std::vector<unsigned int> next_cache;
+    cache.reserve(cache_size + 3);
+    next_cache.reserve(cache_size + 3);
+
+    std::vector<unsigned int> result;
+    result.reserve(indices.size());
+    std::size_t best = static_cast<std::size_t>(std::max_element(triangle_scores.begin(), triangle_scores.end()) - triangle_scores.begin());
+    // unemitted triangles are searched from here when no triangle in the cache is left
+    std::size_t cursor = 0;
+
+    while (result.size() < indices.size()) {
+        const std::array<unsigned int, 3> triangle{indices[3 * best], indices[3 * best + 1], indices[3 * best + 2]};
+        result.insert(result.end(), triangle.begin(), triangle.end());
+        emitted[best] = true;
+
+        // the triangle's vertices move to the front of the cache
+        next_cache.clear();
+        for (const unsigned int v : triangle) {
+            if (std::find(next_cache.begin(), next_cache.end(), v) == next_cache.end()) {
+                next_cache.push_back(v);
+            }
+        }
+        for (const unsigned int v : cache) {
+            if (v != triangle[0] && v != triangle[1] && v != triangle[2]) {
+                next_cache.push_back(v);
+            }
+        }
+        // degenerate triangles are listed once per occurrence of the vertex
+        for (const unsigned int v : triangle) {
+            // remove the triangle from the vertex's remaining triangles
+            auto* begin = vertex_triangles.data() + offsets[v];
+            auto* end = begin + remaining[v];
+            std::iter_swap(std::find(begin, end, static_cast<std::uint32_t>(best)), end - 1);
+            remaining[v]--;
+        }
+        std::swap(cache, next_cache);
+
+        // rescore the cached vertices, the ones that fell out of the cache lose their cache score
+        for (std::size_t i = 0; i < cache.size(); i++) {
+            const unsigned int v = cache[i];
+            cache_position[v] = i < cache_size ? static_cast<int>(i) : -1;
+            vertex_scores[v] = detail::vertex_score(cache_position[v], remaining[v]);
+        }
+        if (cache.size() > cache_size) {
+            cache.resize(cache_size);
+        }
+
+        // the next triangle is the best one touching the cache
+        float best_score = -1.0f;
+        for (const unsigned int v : cache) {
+            for (std::uint32_t i = offsets[v]; i < offsets[v] + remaining[v]; i++) {
+                const std::uint32_t t = vertex_triangles[i];
+                const float score = vertex_scores[indices[3 * t]] + vertex_scores[indices[3 * t + 1]] + vertex_scores[indices[3 * t + 2]];
+                triangle_scores[t] = score;
+                if (score > best_score) {
+                    best_score = score;
+                    best = t;
+                }
+            }
+        }
+        if (best_score < 0.0f) {
+            while (cursor < triangle_count && emitted[cursor]) {
+                cursor++;
+            }
+            best = cursor;
+        }
+    }
+    indices = std::move(result);
+}
+
+// Sorts runs of triangles that start with a cold cache, so the vertex cache order is kept within a run, by how
+// much they face away from the center of the mesh. Outer surfaces are drawn first and occlude the inner ones.
+inline void optimize_overdraw(std::vector<unsigned int>& indices, const std::vector<Vertex>& vertices)
+{
+    const std::size_t triangle_count = indices.size() / 3;
+    if (triangle_count == 0) {
+        return;
+    }
+
+    // a run starts at every triangle whose three vertices all miss the cache
+    std::vector<std::size_t> run_starts;
+    {
+        std::vector<std::size_t> inserted(vertices.size(), 0);
+        std::size_t misses = 0;
+        for (std::size_t t = 0; t < triangle_count; t++) {
+            int triangle_misses = 0;
+            for (std::size_t i = 3 * t; i < 3 * t + 3; i++) {
+                const unsigned int index = indices[i];
+                if (inserted[index] == 0 || misses - inserted[index] + 1 > cache_size) {
+                    misses++;
+                    inserted[index] = misses;
+                    triangle_misses++;
+                }
+            }
+            if (t == 0 || triangle_misses == 3) {
+                run_starts.push_back(t);
+            }
+        }
+    }
+    run_starts.push_back(triangle_count);
+    if (run_starts.size() <= 2) {
+        return;
+    }
+
+    glm::vec3 mesh_center{0.0f};
+    float mesh_area = 0.0f;
+    struct Run
+    {
+        std::size_t begin;
+        std::size_t end;
+        glm::vec3 center;
+        glm::vec3 normal;
+        float sort_key;
+    };
+    std::vector<Run> runs;
+    for (std::size_t r = 0; r + 1 < run_starts.size(); r++) {
+        Run run{run_starts[r], run_starts[r + 1], glm::vec3{0.0f}, glm::vec3{0.0f}, 0.0f};
+        float run_area = 0.0f;
+        for (std::size_t t = run.begin; t < run.end; t++) {
+            const glm::vec3& a = vertices[indices[3 * t]].Position;
+            const glm::vec3& b = vertices[indices[3 * t + 1]].Position;
+            const glm::vec3& c = vertices[indices[3 * t + 2]].Position;
+            // twice the area weighted normal
+            const glm::vec3 normal = glm::cross(b - a, c - a);
+            const float area = glm::length(normal);
+            run.center += (a + b + c) * (area / 3.0f);
+            run.normal += normal;
+            run_area += area;
+        }
+        mesh_center += run.center;
+        mesh_area += run_area;
+        run.center = run_area > 0.0f ? run.center / run_area : vertices[indices[3 * run.begin]].Position;
+        runs.push_back(run);
+    }
+    if (mesh_area > 0.0f) {
+        mesh_center /= mesh_area;
+    }
+    for (Run& run : runs) {
+        const float length = glm::length(run.normal);
+        run.sort_key = length > 0.0f ? glm::dot(run.center - mesh_center, run.normal / length) : 0.0f;
+    }
+    std::stable_sort(runs.begin(), runs.end(), [](const Run& a, const Run& b) { return a.sort_key > b.sort_key; });
+
+    std::vector<unsigned int> result;
+    result.reserve(indices.size());
+    for (const Run& run : runs) {
+        result.insert(result.end(), indices.begin() + static_cast<std::ptrdiff_t>(3 * run.begin),
+                      indices.begin() + static_cast<std::ptrdiff_t>(3 * run.end));
+    }
+    indices = std::move(result);
+}
+
+// reorders the vertices in the order the triangles first use them, vertices no triangle uses are dropped
+inline void optimize_vertex_fetch(std::vector<Vertex>& vertices, std::vector<unsigned int>& indices)
+{
+    constexpr unsigned int unused = ~0u;
+    std::vector<unsigned int> remap(vertices.size(), unused);
+    std::vector<Vertex> result;
+    result.reserve(vertices.size());
+    for (unsigned int& index : indices) {
+        if (remap[index] == unused) {
+            remap[index] = static_cast<unsigned int>(result.size());
+            result.push_back(vertices[index]);
+        }
+        index = remap[index];
+    }
+    vertices = std::move(result);
+}
+
+// splits meshes with more vertices than 16 bit indices can address into parts that fit, in triangle order
+// so the parts keep the vertex cache order. The parts share the mesh's textures.
+inline std::vector<MeshData> split_for_short_indices(std::vector<MeshData> meshes)
+{
+    std::vector<MeshData> result;
+    result.reserve(meshes.size());
+    for (MeshData& mesh : meshes) {
+        if (mesh.vertices.size() <= maxShortIndexVertices) {
+            result.push_back(std::move(mesh));
+            continue;
+        }
+        // remap[v] is valid if part_of[v] is the current part
+        constexpr std::size_t no_part = ~std::size_t{0};
+        std::vector<std::size_t> part_of(mesh.vertices.size(), no_part);
+        std::vector<unsigned int> remap(mesh.vertices.size());
+        std::size_t part = 0;
+        MeshData current{{}, {}, mesh.textures, {}, {}};
+        for (std::size_t t = 0; t + 2 < mesh.indices.size(); t += 3) {
+            std::size_t new_vertices = 0;
+            for (std::size_t i = t; i < t + 3; i++) {
+                new_vertices += part_of[mesh.indices[i]] != part;
+            }
+            if (current.vertices.size() + new_vertices > maxShortIndexVertices) {
+                result.push_back(std::move(current));
+                current = MeshData{{}, {}, mesh.textures, {}, {}};
+                part++;
+            }
+            for (std::size_t i = t; i < t + 3; i++) {
+                const unsigned int v = mesh.indices[i];
+                if (part_of[v] != part) {
+                    part_of[v] = part;
+                    remap[v] = static_cast<unsigned int>(current.vertices.size());
+                    current.vertices.push_back(mesh.vertices[v]);
+                }
+                current.indices.push_back(remap[v]);
+            }
+        }
+        if (!current.indices.empty()) {
+            result.push_back(std::move(current));
+        }
+    }
+    return result;
+}
+
+// runs all optimizations, returns the cache statistics before and after
+inline std::pair<CacheStatistics, CacheStatistics> optimize(std::vector<Vertex>& vertices, std::vector<unsigned int>& indices)
+{
+    const CacheStatistics before = analyze(indices, vertices.size());
+    optimize_vertex_cache(indices, vertices.size());
+    optimize_overdraw(indices, vertices);
+    optimize_vertex_fetch(vertices, indices);
+    return {before, analyze(indices, vertices.size())};
+}
+
+} // namespace mesh_optimizer
+
+#endif //CYBERPUNK_HALLWAY_MESH_OPTIMIZER_H
@@ -0,0 +1,321 @@
+//
+// Mesh simplification for levels of detail: edges are collapsed in the order of the error they add, measured
+// with quadric error metrics (Garland and Heckbert). A vertex is only ever moved onto one of its neighbours,
+// so every level is an index buffer over the original vertices and the levels share one vertex buffer.
+// Vertices split by a seam in the texture coordinates or normals stay in place, and open borders are kept by
+// extra planes along them, so the silhouette and the texturing survive the simplification.
+//
+
+#ifndef CYBERPUNK_HALLWAY_MESH_SIMPLIFIER_H
+#define CYBERPUNK_HALLWAY_MESH_SIMPLIFIER_H
+
+#include <learnopengl/mesh_edited.h>
+#include <mesh_optimizer.h>
+
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <numeric>
+#include <vector>
+
+namespace mesh_simplifier {
+
+// meshes with fewer triangles don't get levels of detail
+constexpr std::size_t min_lod_triangles = 256;
+
+namespace detail {
+
+// weight of the planes along open borders relative to the faces
+constexpr double border_weight = 10.0;
+
+// sum of squared distances to planes, as the symmetric matrix of the quadratic form, with the summed weights
+struct Quadric
+{
+    double a00{}, a01{}, a02{}, a11{}, a12{}, a22{};
+    double b0{}, b1{}, b2{};
+    double c{};
+    double weight{};
+
+    // the plane dot(normal, p) + d = 0 with a unit normal
+    static Quadric plane(const glm::vec3& normal, float d, double weight)
+    {
+        const double x = normal.x;
+        const double y = normal.y;
+        const double z = normal.z;
+        return {weight * x * x, weight * x * y, weight * x * z, weight * y * y, weight * y * z, weight * z * z,
+                weight * x * d, weight * y * d, weight * z * d, weight * d * d, weight};
+    }
+
+    Quadric& operator+=(const Quadric& other)
+    {
+        a00 += other.a00;
+        a01 += other.a01;
+        a02 += other.a02;
+        a11 += other.a11;
+        a12 += other.a12;
+        a22 += other.a22;
+        b0 += other.b0;
+        b1 += other.b1;
+        b2 += other.b2;
+        c += other.c;
+        weight += other.weight;
+        return *this;
+    }
+
+    // weighted mean of the squared distances of the point to the planes
+    [[nodiscard]] double error(const glm::vec3& point) const
+    {
+        if (weight <= 0.0) {
+            return 0.0;
+        }
+        const double x = point.x;
+        const double y = point.y;
+        const double z = point.z;
+        const double sum = a00 * x * x + a11 * y * y + a22 * z * z + 2.0 * (a01 * x * y + a02 * x * z + a12 * y * z) +
+                           2.0 * (b0 * x + b1 * y + b2 * z) + c;
+        return std::max(sum, 0.0) / weight;
+    }
+};
+
+inline Quadric operator+(Quadric a, const Quadric& b)
+{
+    return a += b;
+}
+
+// the first vertex at the same position as each vertex
+inline std::vector<unsigned int> weld_positions(const std::vector<Vertex>& vertices)
+{
+    std::vector<unsigned int> order(vertices.size());
+    std::iota(order.begin(), order.end(), 0u);
+    const auto key = [&](unsigned int vertex) {
+        const glm::vec3& p = vertices[vertex].Position;
+        return std::array<float, 3>{p.x, p.y, p.z};
+    };
+    std::stable_sort(order.begin(), order.end(), [&](unsigned int a, unsigned int b) { return key(a) < key(b); });
+
+    std::vector<unsigned int> position(vertices.size());
+    for (std::size_t i = 0; i < order.size(); i++) {
+        position[order[i]] = i > 0 && key(order[i]) == key(order[i - 1]) ? position[order[i - 1]] : order[i];
+    }
+    return position;
+}
+
+inline std::uint64_t edge_key(unsigned int from, unsigned int to)
+{
+    return std::uint64_t{from} << 32 | to;
+}
+
+// directed edges of the triangles between welded positions, sorted
+inline std::vector<std::uint64_t> directed_edges(const std::vector<unsigned int>& indices, const std::vector<unsigned int>& position)
+{
+    std::vector<std::uint64_t> edges;
+    edges.reserve(indices.size());
+    for (std::size_t i = 0; i < indices.size(); i += 3) {
+        for (std::size_t corner = 0; corner < 3; corner++) {
+            edges.push_back(edge_key(position[indices[i + corner]], position[indices[i + (corner + 1) % 3]]));
+        }
+    }
+    std::sort(edges.begin(), edges.end());
+    return edges;
+}
+
+inline glm::vec3 triangle_normal(const glm::vec3& a, const glm::vec3& b, const glm::vec3& c)
+{
+    return glm::cross(b - a, c - a);
+}
+
+} // namespace detail
+
+// collapses edges until at most target_index_count indices are left or no edge can be collapsed any more
+inline MeshLodData simplify(const std::vector<Vertex>& vertices, const std::vector<unsigned int>& indices, std::size_t target_index_count)
+{
+    using namespace detail;
+    const std::vector<unsigned int> position = weld_positions(vertices);
+    std::vector<std::uint32_t> wedges(vertices.size());
+    for (const unsigned int p : position) {
+        wedges[p]++;
+    }
+
+    // the planes of the faces around each position, weighted by area, and of the open borders
+    std::vector<Quadric> quadrics(vertices.size());
+    std::vector<bool> border(vertices.size());
+    const std::vector<std::uint64_t> initial_edges = directed_edges(indices, position);
+    for (std::size_t i = 0; i < indices.size(); i += 3) {
+        const std::array<unsigned int, 3> p{position[indices[i]], position[indices[i + 1]], position[indices[i + 2]]};
+        const glm::vec3 normal = triangle_normal(vertices[p[0]].Position, vertices[p[1]].Position, vertices[p[2]].Position);
+        const float double_area = glm::length(normal);
+        if (double_area == 0.0f) {
+            continue;
+        }
+        const glm::vec3 unit_normal = normal / double_area;
+        const Quadric face = Quadric::plane(unit_normal, -glm::dot(unit_normal, vertices[p[0]].Position), 0.5 * double_area);
+        for (std::size_t corner = 0; corner < 3; corner++) {
+            quadrics[p[corner]] += face;
+            const unsigned int a = p[corner];
+            const unsigned int b = p[(corner + 1) % 3];
+            if (std::binary_search(initial_edges.begin(), initial_edges.end(), edge_key(b, a))) {
+                continue;
+            }
+            // the plane through the border edge, perpendicular to the face
+            const glm::vec3 edge = vertices[b].Position - vertices[a].Position;
+            const float length = glm::length(edge);
+            if (length == 0.0f) {
+                continue;
+            }
+            const glm::vec3 side = glm::normalize(glm::cross(edge, unit_normal));
+            const Quadric plane = Quadric::plane(side, -glm::dot(side, vertices[a].Position), border_weight * length * length);
+            quadrics[a] += plane;
+            quadrics[b] += plane;
+            border[a] = border[b] = true;
+        }
+    }
+
+    struct Collapse
+    {
+        unsigned int from;
+        unsigned int to;
+        double error;
+    };
+
+    std::vector<unsigned int> result = indices;
+    std::vector<unsigned int> collapsed_to(vertices.size());
+    std::iota(collapsed_to.begin(), collapsed_to.end(), 0u);
+    double max_error = 0.0;
+    std::vector<Collapse> collapses;
+    std::vector<std::uint32_t> first_triangle;
+    std::vector<std::uint32_t> vertex_triangles;
+    std::vector<bool> locked;
+    while (result.size() > target_index_count) {
+        const std::vector<std::uint64_t> edges = directed_edges(result, position);
+        const auto is_border_edge = [&](unsigned int a, unsigned int b) {
+            return !std::binary_search(edges.begin(), edges.end(), edge_key(a, b)) ||
+                   !std::binary_search(edges.begin(), edges.end(), edge_key(b, a));
+        };
+
+        // a vertex can move onto a neighbour unless it's on a seam, border vertices only along the border
+        collapses.clear();
+        for (std::size_t i = 0; i < result.size(); i += 3) {
+            for (std::size_t corner = 0; corner < 3; corner++) {
+                const unsigned int a = result[i + corner];
+                const unsigned int b = result[i + (corner + 1) % 3];
+                for (const auto& [from, to] : {std::pair{a, b}, std::pair{b, a}}) {
+                    if (wedges[position[from]] != 1 || position[from] == position[to] ||
+                        (border[from] && !is_border_edge(position[from], position[to]))) {
+                        continue;
+                    }
+                    const Quadric sum = quadrics[position[from]] + quadrics[position[to]];
+                    collapses.push_back({from, to, sum.error(vertices[to].Position)});
+                }
+            }
+        }
+        std::sort(collapses.begin(), collapses.end(), [](const Collapse& a, const Collapse& b) { return a.error < b.error; });
+
+        // triangles around each vertex
+        first_triangle.assign(vertices.size() + 1, 0);
+        for (const unsigned int index : result) {
+            first_triangle[index + 1]++;
+        }
+        std::partial_sum(first_triangle.begin(), first_triangle.end(), first_triangle.begin());
+        vertex_triangles.resize(result.size());
+        {
+            std::vector<std::uint32_t> next(first_triangle.begin(), first_triangle.end() - 1);
+            for (std::size_t i = 0; i < result.size(); i++) {
+                vertex_triangles[next[result[i]]++] = static_cast<std::uint32_t>(i / 3);
+            }
+        }
+
+        // collapses whose neighbourhoods don't overlap, cheapest first, about as many as are still needed
+        const std::size_t needed = (result.size() - target_index_count) / 6 + 1;
+        std::size_t done = 0;
+        locked.assign(vertices.size(), false);
+        for (const Collapse& collapse : collapses) {
+            if (done == needed) {
+                break;
+            }
+            const unsigned int from_position = position[collapse.from];
+            const unsigned int to_position = position[collapse.to];
+            if (locked[from_position] || locked[to_position]) {
+                continue;
+            }
+            // the triangles that stay must not flip over
+            bool flips = false;
+            for (std::uint32_t t = first_triangle[collapse.from]; t < first_triangle[collapse.from + 1] && !flips; t++) {
+                const unsigned int* triangle = &result[3 * std::size_t{vertex_triangles[t]}];
+                if (position[triangle[0]] == to_position || position[triangle[1]] == to_position || position[triangle[2]] == to_position) {
+                    continue;
+                }
+                std::array<glm::vec3, 3> corners{vertices[triangle[0]].Position, vertices[triangle[1]].Position, vertices[triangle[2]].Position};
+                const glm::vec3 before = triangle_normal(corners[0], corners[1], corners[2]);
+                for (std::size_t corner = 0; corner < 3; corner++) {
+                    if (triangle[corner] == collapse.from) {
+                        corners[corner] = vertices[collapse.to].Position;
+                    }
+                }
+                // turning by more than about 75 degrees counts too, it makes slivers along the borders
+                const glm::vec3 after = triangle_normal(corners[0], corners[1], corners[2]);
+                flips = glm::dot(before, after) <= 0.25f * glm::length(before) * glm::length(after);
+            }
+            if (flips) {
+                continue;
+            }
+
+            collapsed_to[collapse.from] = collapse.to;
+            quadrics[to_position] += quadrics[from_position];
+            max_error = std::max(max_error, collapse.error);
+            for (std::uint32_t t = first_triangle[collapse.from]; t < first_triangle[collapse.from + 1]; t++) {
+                for (std::size_t corner = 0; corner < 3; corner++) {
+                    locked[position[result[3 * std::size_t{vertex_triangles[t]} + corner]]] = true;
+                }
+            }
+            done++;
+        }
+        if (done == 0) {
+            break;
+        }
+
+        // moves the collapsed vertices and drops the triangles that became degenerate
+        std::size_t kept = 0;
+        for (std::size_t i = 0; i < result.size(); i += 3) {
+            const std::array<unsigned int, 3> triangle{collapsed_to[result[i]], collapsed_to[result[i + 1]], collapsed_to[result[i + 2]]};
+            if (position[triangle[0]] == position[triangle[1]] || position[triangle[1]] == position[triangle[2]] ||
+                position[triangle[2]] == position[triangle[0]]) {
+                continue;
+            }
+            std::copy(triangle.begin(), triangle.end(), result.begin() + static_cast<std::ptrdiff_t>(kept));
+            kept += 3;
+        }
+        result.resize(kept);
+    }
+    return {std::move(result), static_cast<float>(std::sqrt(max_error))};
+}
+
+// levels with about a half, a quarter and an eighth of the triangles, each simplified from the full mesh and
+// optimized for the vertex cache. Stops early once a level hardly gets smaller, e.g. when seams keep most of
+// the vertices in place.
+inline std::vector<MeshLodData> generate_lods(const std::vector<Vertex>& vertices, const std::vector<unsigned int>& indices)
+{
+    std::vector<MeshLodData> lods;
+    std::size_t previous_size = indices.size();
+    for (std::size_t level = 1; level < maxLodLevels; level++) {
+        const std::size_t target = (indices.size() / 3 >> level) * 3;
+        if (target < 3 * min_lod_triangles) {
+            break;
+        }
+        MeshLodData lod = simplify(vertices, indices, target);
+        if (lod.indices.size() > previous_size / 8 * 7) {
+            break;
+        }
+        mesh_optimizer::optimize_vertex_cache(lod.indices, vertices.size());
+        previous_size = lod.indices.size();
+        lods.push_back(std::move(lod));
+    }
+    return lods;
+}
+
+} // namespace mesh_simplifier
+
+#endif //CYBERPUNK_HALLWAY_MESH_SIMPLIFIER_H
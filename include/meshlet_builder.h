@@ -0,0 +1,184 @@
+//
+// Splits a mesh into meshlets, clusters of up to max_triangles neighbouring triangles using at most
+// max_vertices vertices. A meshlet grows from a seed triangle by the neighbour adding the fewest new vertices,
+// preferring the ones facing like the meshlet, so meshlets are compact and have narrow normal cones. The index
+// buffer is reordered so every meshlet is a contiguous range of it, which makes a set of meshlets drawable
+// with glMultiDrawElements. Each meshlet gets a bounding sphere for frustum culling and a normal cone for
+// culling meshlets that face away from the camera as a whole.
+//
+
+#ifndef CYBERPUNK_HALLWAY_MESHLET_BUILDER_H
+#define CYBERPUNK_HALLWAY_MESHLET_BUILDER_H
+
+#include <learnopengl/mesh_edited.h>
+
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <numeric>
+#include <vector>
+
+namespace meshlet_builder {
+
+constexpr std::size_t max_vertices = 64;
+constexpr std::size_t max_triangles = 124;
+// meshes with fewer triangles are drawn whole
+constexpr std::size_t min_mesh_triangles = 4 * max_triangles;
+
+namespace detail {
+
+// meshlets whose normals spread wider than this (the cosine of the widest normal to the axis) aren't cone culled
+constexpr float min_cone_spread = 0.1f;
+
+inline glm::vec3 face_normal(const std::vector<Vertex>& vertices, const unsigned int* triangle)
+{
+    const glm::vec3& a = vertices[triangle[0]].Position;
+    const glm::vec3 normal = glm::cross(vertices[triangle[1]].Position - a, vertices[triangle[2]].Position - a);
+    const float length = glm::length(normal);
+    return length > 0.0f ? normal / length : glm::vec3{0.0f};
+}
+
+// the sphere around the box of the meshlet's vertices, and the cone around its face normals
+inline void compute_bounds(Meshlet& meshlet, const std::vector<Vertex>& vertices, const std::vector<unsigned int>& indices)
+{
+    glm::vec3 min{std::numeric_limits<float>::max()};
+    glm::vec3 max{-std::numeric_limits<float>::max()};
+    glm::vec3 normal_sum{0.0f};
+    for (std::uint32_t i = meshlet.firstIndex; i < meshlet.firstIndex + meshlet.indexCount; i += 3) {
+        for (std::uint32_t corner = 0; corner < 3; corner++) {
+            min = glm::min(min, vertices[indices[i + corner]].Position);
+            max = glm::max(max, vertices[indices[i + corner]].Position);
+        }
+        normal_sum += face_normal(vertices, &indices[i]);
+    }
+    meshlet.center = (min + max) * 0.5f;
+    meshlet.radius = 0.0f;
+    for (std::uint32_t i = meshlet.firstIndex; i < meshlet.firstIndex + meshlet.indexCount; i++) {
+        meshlet.radius = std::max(meshlet.radius, glm::length(vertices[indices[i]].Position - meshlet.center));
+    }
+
+    const float length = glm::length(normal_sum);
+    meshlet.coneAxis = length > 0.0f ? normal_sum / length : glm::vec3{0.0f, 0.0f, 1.0f};
+    float min_dot = length > 0.0f ? 1.0f : -1.0f;
+    for (std::uint32_t i = meshlet.firstIndex; i < meshlet.firstIndex + meshlet.indexCount; i += 3) {
+        const glm::vec3 normal = face_normal(vertices, &indices[i]);
+        if (normal != glm::vec3{0.0f}) {
+            min_dot = std::min(min_dot, glm::dot(normal, meshlet.coneAxis));
+        }
+    }
+    // the sine of the cone's half angle
+    meshlet.coneCutoff = min_dot <= min_cone_spread ? 1.0f : std::sqrt(1.0f - min_dot * min_dot);
+}
+
+} // namespace detail
+
+// reorders the triangles of the index buffer into meshlets and returns them, in index buffer order
+inline std::vector<Meshlet> build(const std::vector<Vertex>& vertices, std::vector<unsigned int>& indices)
+{
+    using namespace detail;
+    const std::size_t triangle_count = indices.size() / 3;
+    if (triangle_count < min_mesh_triangles) {
+        return {};
+    }
+
+    // triangles around each vertex
+    std::vector<std::uint32_t> first_triangle(vertices.size() + 1, 0);
+    for (const unsigned int index : indices) {
+        first_triangle[index + 1]++;
+    }
+    std::partial_sum(first_triangle.begin(), first_triangle.end(), first_triangle.begin());
+    std::vector<std::uint32_t> vertex_triangles(indices.size());
+    {
+        std::vector<std::uint32_t> next(first_triangle.begin(), first_triangle.end() - 1);
+        for (std::size_t i = 0; i < indices.size(); i++) {
+            vertex_triangles[next[indices[i]]++] = static_cast<std::uint32_t>(i / 3);
+        }
+    }
+
+    constexpr std::uint32_t none = std::numeric_limits<std::uint32_t>::max();
+    std::vector<bool> emitted(triangle_count);
+    // the meshlet a vertex was last added to
+    std::vector<std::uint32_t> vertex_meshlet(vertices.size(), none);
+    std::vector<unsigned int> reordered;
+    reordered.reserve(indices.size());
+    std::vector<Meshlet> meshlets;
+    std::vector<unsigned int> meshlet_vertices;
+    std::size_t seed = 0;
+
+    while (reordered.size() < indices.size()) {
+        while (emitted[seed]) {
+            seed++;
+        }
+        const auto meshlet_index = static_cast<std::uint32_t>(meshlets.size());
+        Meshlet& meshlet = meshlets.emplace_back();
+        meshlet.firstIndex = static_cast<std::uint32_t>(reordered.size());
+        meshlet_vertices.clear();
+        glm::vec3 normal_sum{0.0f};
+
+        const auto new_vertices = [&](std::size_t triangle) {
+            std::size_t count = 0;
+            for (std::size_t corner = 0; corner < 3; corner++) {
+                count += vertex_meshlet[indices[3 * triangle + corner]] != meshlet_index;
+            }
+            return count;
+        };
+        const auto add = [&](std::size_t triangle) {
+            emitted[triangle] = true;
+            for (std::size_t corner = 0; corner < 3; corner++) {
+                const unsigned int vertex = indices[3 * triangle + corner];
+                if (vertex_meshlet[vertex] != meshlet_index) {
+                    vertex_meshlet[vertex] = meshlet_index;
+                    meshlet_vertices.push_back(vertex);
+                }
+                reordered.push_back(vertex);
+            }
+            normal_sum += face_normal(vertices, &indices[3 * triangle]);
+        };
+
+        add(seed);
+        for (std::size_t triangles = 1; triangles < max_triangles; triangles++) {
+            // the unused neighbour adding the fewest vertices, then the one facing most like the meshlet
+            std::size_t best = triangle_count;
+            std::size_t best_new_vertices = 4;
+            float best_facing = 0.0f;
+            for (const unsigned int vertex : meshlet_vertices) {
+                for (std::uint32_t t = first_triangle[vertex]; t < first_triangle[vertex + 1]; t++) {
+                    const std::uint32_t triangle = vertex_triangles[t];
+                    if (emitted[triangle]) {
+                        continue;
+                    }
+                    const std::size_t added = new_vertices(triangle);
+                    if (meshlet_vertices.size() + added > max_vertices || added > best_new_vertices) {
+                        continue;
+                    }
+                    const float facing = glm::dot(face_normal(vertices, &indices[3 * std::size_t{triangle}]), normal_sum);
+                    if (added < best_new_vertices || facing > best_facing) {
+                        best = triangle;
+                        best_new_vertices = added;
+                        best_facing = facing;
+                    }
+                }
+            }
+            if (best == triangle_count) {
+                break;
+            }
+            add(best);
+        }
+        meshlet.indexCount = static_cast<std::uint32_t>(reordered.size()) - meshlet.firstIndex;
+    }
+
+    indices = std::move(reordered);
+    for (Meshlet& meshlet : meshlets) {
+        compute_bounds(meshlet, vertices, indices);
+    }
+    return meshlets;
+}
+
+} // namespace meshlet_builder
+
+#endif //CYBERPUNK_HALLWAY_MESHLET_BUILDER_H
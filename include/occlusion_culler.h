@@ -0,0 +1,357 @@
+//
+// Software occlusion culling: large occluders are rasterized into a small depth buffer on the CPU and the
+// bounding boxes of the objects are tested against it before they are submitted. Occluders are low poly
+// proxies that have to lie inside what they stand for, like the hallway walls or the props' bounding boxes
+// shrunk towards their centers. The buffer is split into bands of rows that the thread pool rasterizes in
+// parallel, four pixels at a time with SSE2 where it's available. Every tile keeps the farthest depth of its
+// pixels, so most boxes are decided without reading single pixels. Runs entirely without the GPU.
+//
+
+#ifndef CYBERPUNK_HALLWAY_OCCLUSION_CULLER_H
+#define CYBERPUNK_HALLWAY_OCCLUSION_CULLER_H
+
+#include <glm/glm.hpp>
+
+#include <frustum.h>
+#include <learnopengl/mesh_edited.h>
+#include <thread_pool.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstddef>
+#include <future>
+#include <vector>
+
+// object space triangles standing in for a mesh in the occlusion buffer
+struct OccluderMesh
+{
+    // three vertices per triangle
+    std::vector<glm::vec3> triangles;
+    BoundingBox bounds;
+
+    static OccluderMesh from_mesh(const MeshData& mesh)
+    {
+        OccluderMesh occluder;
+        occluder.triangles.reserve(mesh.indices.size());
+        for (const unsigned index : mesh.indices) {
+            occluder.triangles.push_back(mesh.vertices[index].Position);
+        }
+        occluder.compute_bounds();
+        return occluder;
+    }
+
+    // the box scaled by shrink around its center, for objects that fill most of their bounds
+    static OccluderMesh box(const BoundingBox& bounds, float shrink)
+    {
+        const glm::vec3 center = bounds.center();
+        const glm::vec3 extent = (bounds.max - bounds.min) * 0.5f * shrink;
+        const auto corner = [&](int i) {
+            return center + extent * glm::vec3{i & 1 ? 1.f : -1.f, i & 2 ? 1.f : -1.f, i & 4 ? 1.f : -1.f};
+        };
+        // two triangles for each face, corners are numbered by the bits x, y, z
+        constexpr std::array<int, 36> indices{0, 2, 3, 0, 3, 1, 4, 5, 7, 4, 7, 6, 0, 1, 5, 0, 5, 4,
+                                              2, 6, 7, 2, 7, 3, 0, 4, 6, 0, 6, 2, 1, 3, 7, 1, 7, 5};
+        OccluderMesh occluder;
+        for (const int i : indices) {
+            occluder.triangles.push_back(corner(i));
+        }
+        occluder.compute_bounds();
+        return occluder;
+    }
+
+private:
+    void compute_bounds()
+    {
+        if (triangles.empty()) {
+            return;
+        }
+        bounds = {triangles.front(), triangles.front()};
+        for (const glm::vec3& vertex : triangles) {
+            bounds.min = glm::min(bounds.min, vertex);
+            bounds.max = glm::max(bounds.max, vertex);
+        }
+    }
+};
+
+class OcclusionCuller
+{
+public:
+    static constexpr int width = 256;
+    static constexpr int height = 144;
+    static constexpr int tile_size = 8;
+    static constexpr int tiles_x = width / tile_size;
+    static constexpr int tiles_y = height / tile_size;
+    static_assert(width % tile_size == 0 && height % tile_size == 0 && tile_size % 4 == 0);
+
+    explicit OcclusionCuller(ThreadPool& pool)
+        : m_pool{pool}, m_depth(width * height, 1.0f), m_tile_depth(tiles_x * tiles_y, 1.0f)
+    {
+    }
+
+    OcclusionCuller(const OcclusionCuller&) = delete;
+    OcclusionCuller& operator=(const OcclusionCuller&) = delete;
+
+    // forgets the last frame's occluders, the buffer stays empty until rasterize()
+    void begin_frame(const glm::mat4& view_projection)
+    {
+        m_view_projection = view_projection;
+        m_frustum = Frustum{view_projection};
+        m_triangles.clear();
+        std::fill(m_depth.begin(), m_depth.end(), 1.0f);
+        std::fill(m_tile_depth.begin(), m_tile_depth.end(), 1.0f);
+    }
+
+    // queues the occluder's triangles for rasterize(), occluders outside the frustum are skipped
+    void add(const OccluderMesh& occluder, const glm::mat4& model)
+    {
+        if (!m_frustum.intersects(occluder.bounds.transformed(model))) {
+            return;
+        }
+        const glm::mat4 transform = m_view_projection * model;
+        for (std::size_t i = 0; i + 2 < occluder.triangles.size(); i += 3) {
+            add_triangle({transform * glm::vec4(occluder.triangles[i], 1.0f), transform * glm::vec4(occluder.triangles[i + 1], 1.0f),
+                          transform * glm::vec4(occluder.triangles[i + 2], 1.0f)});
+        }
+    }
+
+    // rasterizes the queued occluders on the thread pool and waits for it
+    void rasterize()
+    {
+        const int bands = std::clamp(static_cast<int>(m_pool.size()), 1, tiles_y);
+        std::vector<std::future<void>> done;
+        done.reserve(static_cast<std::size_t>(bands));
+        for (int band = 0; band < bands; band++) {
+            const int first_tile_row = tiles_y * band / bands;
+            const int last_tile_row = tiles_y * (band + 1) / bands;
+            done.push_back(m_pool.submit([this, first_tile_row, last_tile_row] { rasterize_band(first_tile_row, last_tile_row); }));
+        }
+        for (auto& band : done) {
+            band.get();
+        }
+    }
+
+    // false if the world space box is hidden behind the rasterized occluders
+    [[nodiscard]] bool visible(const BoundingBox& box) const
+    {
+        glm::vec2 screen_min{static_cast<float>(width), static_cast<float>(height)};
+        glm::vec2 screen_max{0.0f};
+        float nearest = 1.0f;
+        for (int i = 0; i < 8; i++) {
+            const glm::vec3 corner{i & 1 ? box.max.x : box.min.x, i & 2 ? box.max.y : box.min.y, i & 4 ? box.max.z : box.min.z};
+            const glm::vec4 clip = m_view_projection * glm::vec4(corner, 1.0f);
+            // boxes reaching in front of the near plane are too close to test
+            if (clip.w <= 0.0f || clip.z < -clip.w) {
+                return true;
+            }
+            const glm::vec3 screen = to_screen(clip);
+            screen_min = glm::min(screen_min, glm::vec2{screen.x, screen.y});
+            screen_max = glm::max(screen_max, glm::vec2{screen.x, screen.y});
+            nearest = std::min(nearest, screen.z);
+        }
+        const int x_begin = std::max(static_cast<int>(std::floor(screen_min.x)), 0);
+        const int y_begin = std::max(static_cast<int>(std::floor(screen_min.y)), 0);
+        const int x_end = std::min(static_cast<int>(std::ceil(screen_max.x)), width);
+        const int y_end = std::min(static_cast<int>(std::ceil(screen_max.y)), height);
+        if (x_begin >= x_end || y_begin >= y_end) {
+            return true;
+        }
+
+        for (int tile_y = y_begin / tile_size; tile_y * tile_size < y_end; tile_y++) {
+            for (int tile_x = x_begin / tile_size; tile_x * tile_size < x_end; tile_x++) {
+                if (m_tile_depth[tile_y * tiles_x + tile_x] < nearest) {
+                    continue;
+                }
+                // testing the rest of a group of four pixels only makes the result more conservative
+                const int tile_x_begin = std::max(x_begin, tile_x * tile_size) & ~3;
+                const int tile_x_end = std::min(x_end, (tile_x + 1) * tile_size);
+                const int tile_y_end = std::min(y_end, (tile_y + 1) * tile_size);
+                for (int y = std::max(y_begin, tile_y * tile_size); y < tile_y_end; y++) {
+                    for (int x = tile_x_begin; x < tile_x_end; x += 4) {
+                        if (any_not_nearer(&m_depth[y * width + x], nearest)) {
+                            return true;
+                        }
+                    }
+                }
+            }
+        }
+        return false;
+    }
+
+    // occluder triangles rasterized in the current frame
+    [[nodiscard]] std::size_t triangle_count() const
+    {
+        return m_triangles.size();
+    }
+
+private:
+    struct Triangle
+    {
+        // x and y in pixels, z is the normalized device depth
+        std::array<glm::vec3, 3> vertices;
+        int y_begin;
+        int y_end;
+    };
+
+    static glm::vec3 to_screen(const glm::vec4& clip)
+    {
+        const glm::vec3 ndc = glm::vec3{clip} / clip.w;
+        return {(ndc.x * 0.5f + 0.5f) * width, (ndc.y * 0.5f + 0.5f) * height, ndc.z};
+    }
+
+    // clips the triangle against the near plane, the far plane and the sides are left to the rasterizer
+    void add_triangle(const std::array<glm::vec4, 3>& clip)
+    {
+        std::array<glm::vec4, 4> polygon;
+        std::size_t count = 0;
+        for (std::size_t i = 0; i < 3; i++) {
+            const glm::vec4& a = clip[i];
+            const glm::vec4& b = clip[(i + 1) % 3];
+            const float distance_a = a.z + a.w;
+            const float distance_b = b.z + b.w;
+            if (distance_a >= 0.0f) {
+                polygon[count++] = a;
+            }
+            if ((distance_a >= 0.0f) != (distance_b >= 0.0f)) {
+                polygon[count++] = a + (b - a) * (distance_a / (distance_a - distance_b));
+            }
+        }
+        for (std::size_t i = 2; i < count; i++) {
+            add_screen_triangle({to_screen(polygon[0]), to_screen(polygon[i - 1]), to_screen(polygon[i])});
+        }
+    }
+
+    void add_screen_triangle(const std::array<glm::vec3, 3>& vertices)
+    {
+        const float y_min = std::min({vertices[0].y, vertices[1].y, vertices[2].y});
+        const float y_max = std::max({vertices[0].y, vertices[1].y, vertices[2].y});
+        const float x_min = std::min({vertices[0].x, vertices[1].x, vertices[2].x});
+        const float x_max = std::max({vertices[0].x, vertices[1].x, vertices[2].x});
+        if (y_max < 0.0f || y_min > height || x_max < 0.0f || x_min > width) {
+            return;
+        }
+        m_triangles.push_back({vertices, std::max(static_cast<int>(y_min), 0), std::min(static_cast<int>(std::ceil(y_max)), height)});
+    }
+
+    void rasterize_band(int first_tile_row, int last_tile_row)
+    {
+        const int y_begin = first_tile_row * tile_size;
+        const int y_end = last_tile_row * tile_size;
+        for (const Triangle& triangle : m_triangles) {
+            if (triangle.y_end > y_begin && triangle.y_begin < y_end) {
+                rasterize_triangle(triangle, std::max(triangle.y_begin, y_begin), std::min(triangle.y_end, y_end));
+            }
+        }
+        for (int tile_y = first_tile_row; tile_y < last_tile_row; tile_y++) {
+            for (int tile_x = 0; tile_x < tiles_x; tile_x++) {
+                float farthest = 0.0f;
+                for (int y = tile_y * tile_size; y < (tile_y + 1) * tile_size; y++) {
+                    const float* row = &m_depth[y * width + tile_x * tile_size];
+                    farthest = std::max(farthest, *std::max_element(row, row + tile_size));
+                }
+                m_tile_depth[tile_y * tiles_x + tile_x] = farthest;
+            }
+        }
+    }
+
+    // edge functions and depth as a * x + b * y + c, evaluated at pixel centers
+    struct Plane
+    {
+        float a;
+        float b;
+        float c;
+    };
+
+    void rasterize_triangle(const Triangle& triangle, int y_begin, int y_end)
+    {
+        auto v = triangle.vertices;
+        float area = (v[1].x - v[0].x) * (v[2].y - v[0].y) - (v[1].y - v[0].y) * (v[2].x - v[0].x);
+        if (std::abs(area) < 1e-6f) {
+            return;
+        }
+        // occluders are rasterized from both sides
+        if (area < 0.0f) {
+            std::swap(v[1], v[2]);
+            area = -area;
+        }
+        // edge i runs from vertex i to the next one and is zero at the vertex opposite to it. Pixels centered on
+        // an edge are covered by both triangles sharing it, so meshes have no cracks.
+        std::array<Plane, 3> edges;
+        for (int i = 0; i < 3; i++) {
+            const glm::vec3& from = v[i];
+            const glm::vec3& to = v[(i + 1) % 3];
+            edges[i] = {from.y - to.y, to.x - from.x, 0.0f};
+            edges[i].c = -(edges[i].a * from.x + edges[i].b * from.y);
+        }
+        Plane depth{0.0f, 0.0f, 0.0f};
+        for (int i = 0; i < 3; i++) {
+            const float z = v[(i + 2) % 3].z / area;
+            depth = {depth.a + edges[i].a * z, depth.b + edges[i].b * z, depth.c + edges[i].c * z};
+        }
+
+        const float x_min = std::min({v[0].x, v[1].x, v[2].x});
+        const float x_max = std::max({v[0].x, v[1].x, v[2].x});
+        const int x_begin = std::max(static_cast<int>(x_min), 0) & ~3;
+        const int x_end = std::min(static_cast<int>(std::ceil(x_max)), width);
+        for (int y = y_begin; y < y_end; y++) {
+            const float center_y = static_cast<float>(y) + 0.5f;
+            for (int x = x_begin; x < x_end; x += 4) {
+                write_pixels(&m_depth[y * width + x], static_cast<float>(x) + 0.5f, center_y, edges, depth);
+            }
+        }
+    }
+
+#if defined(__SSE2__)
+    static void write_pixels(float* pixels, float x, float y, const std::array<Plane, 3>& edges, const Plane& depth)
+    {
+        const __m128 xs = _mm_add_ps(_mm_set1_ps(x), _mm_setr_ps(0.0f, 1.0f, 2.0f, 3.0f));
+        const auto evaluate = [&](const Plane& plane) {
+            return _mm_add_ps(_mm_mul_ps(_mm_set1_ps(plane.a), xs), _mm_set1_ps(plane.b * y + plane.c));
+        };
+        const __m128 zero = _mm_setzero_ps();
+        const __m128 inside = _mm_and_ps(_mm_and_ps(_mm_cmpge_ps(evaluate(edges[0]), zero), _mm_cmpge_ps(evaluate(edges[1]), zero)),
+                                         _mm_cmpge_ps(evaluate(edges[2]), zero));
+        if (_mm_movemask_ps(inside) == 0) {
+            return;
+        }
+        const __m128 old_depth = _mm_loadu_ps(pixels);
+        const __m128 new_depth = _mm_min_ps(old_depth, evaluate(depth));
+        _mm_storeu_ps(pixels, _mm_or_ps(_mm_and_ps(inside, new_depth), _mm_andnot_ps(inside, old_depth)));
+    }
+
+    static bool any_not_nearer(const float* pixels, float depth)
+    {
+        return _mm_movemask_ps(_mm_cmpge_ps(_mm_loadu_ps(pixels), _mm_set1_ps(depth))) != 0;
+    }
+#else
+    static void write_pixels(float* pixels, float x, float y, const std::array<Plane, 3>& edges, const Plane& depth)
+    {
+        for (int i = 0; i < 4; i++) {
+            const float px = x + static_cast<float>(i);
+            const auto evaluate = [&](const Plane& plane) { return plane.a * px + plane.b * y + plane.c; };
+            if (evaluate(edges[0]) >= 0.0f && evaluate(edges[1]) >= 0.0f && evaluate(edges[2]) >= 0.0f) {
+                pixels[i] = std::min(pixels[i], evaluate(depth));
+            }
+        }
+    }
+
+    static bool any_not_nearer(const float* pixels, float depth)
+    {
+        return pixels[0] >= depth || pixels[1] >= depth || pixels[2] >= depth || pixels[3] >= depth;
+    }
+#endif
+
+    ThreadPool& m_pool;
+    glm::mat4 m_view_projection{1.0f};
+    Frustum m_frustum;
+    std::vector<Triangle> m_triangles;
+    std::vector<float> m_depth;
+    // farthest depth of each tile
+    std::vector<float> m_tile_depth;
+};
+
+#endif //CYBERPUNK_HALLWAY_OCCLUSION_CULLER_H
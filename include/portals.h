@@ -0,0 +1,193 @@
+//
+// Cells and portals: the scene is split into cells connected by portal quads. Starting from the camera's cell,
+// the traversal projects every portal of a visible cell to the screen and clips it with the screen rectangle
+// the cell was seen through. Where some of the portal is left, the cell behind it is visible through that
+// smaller rectangle. A portal the camera is passing through, closer than the near plane, shows the next cell
+// through the whole rectangle. Every visible cell gets a frustum narrowed to its rectangle, so the cost of a
+// frame depends on what can be seen, not on the size of the scene. The cells must form a tree, like the
+// segments of a corridor.
+//
+
+#ifndef CYBERPUNK_HALLWAY_PORTALS_H
+#define CYBERPUNK_HALLWAY_PORTALS_H
+
+#include <glm/glm.hpp>
+
+#include <frustum.h>
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <limits>
+#include <vector>
+
+class PortalGraph
+{
+public:
+    // normalized device coordinates
+    struct ScreenRect
+    {
+        glm::vec2 min{-1.0f};
+        glm::vec2 max{1.0f};
+
+        [[nodiscard]] bool empty() const
+        {
+            return min.x >= max.x || min.y >= max.y;
+        }
+    };
+
+    struct VisibleCell
+    {
+        std::size_t cell;
+        ScreenRect rect;
+        // the view frustum narrowed to the rectangle
+        Frustum frustum;
+    };
+
+    explicit PortalGraph(std::size_t cell_count = 0)
+        : m_cell_portals(cell_count)
+    {
+    }
+
+    // a two sided portal between the cells
+    void add_portal(std::size_t a, std::size_t b, const std::array<glm::vec3, 4>& corners)
+    {
+        m_cell_portals[a].push_back(m_portals.size());
+        m_cell_portals[b].push_back(m_portals.size());
+        m_portals.push_back({corners, {a, b}});
+    }
+
+    // the cells that can be seen from the camera's cell, which comes first
+    const std::vector<VisibleCell>& traverse(const glm::mat4& view_projection, const glm::vec3& camera_position,
+                                             std::size_t camera_cell)
+    {
+        m_visible.clear();
+        if (camera_cell < m_cell_portals.size()) {
+            visit(view_projection, camera_position, camera_cell, no_portal, ScreenRect{});
+        }
+        return m_visible;
+    }
+
+    // every cell with the whole view frustum, for comparing against the traversal
+    const std::vector<VisibleCell>& all(const glm::mat4& view_projection)
+    {
+        m_visible.clear();
+        for (std::size_t cell = 0; cell < m_cell_portals.size(); cell++) {
+            m_visible.push_back({cell, ScreenRect{}, Frustum{view_projection}});
+        }
+        return m_visible;
+    }
+
+    [[nodiscard]] std::size_t cell_count() const
+    {
+        return m_cell_portals.size();
+    }
+
+private:
+    static constexpr std::size_t no_portal = std::numeric_limits<std::size_t>::max();
+
+    struct Portal
+    {
+        std::array<glm::vec3, 4> corners;
+        std::array<std::size_t, 2> cells;
+    };
+
+    void visit(const glm::mat4& view_projection, const glm::vec3& camera_position, std::size_t cell,
+               std::size_t entered_through, const ScreenRect& rect)
+    {
+        m_visible.push_back({cell, rect, narrowed_frustum(view_projection, rect)});
+        for (const std::size_t portal_index : m_cell_portals[cell]) {
+            if (portal_index == entered_through) {
+                continue;
+            }
+            const Portal& portal = m_portals[portal_index];
+            ScreenRect portal_rect;
+            if (!project(view_projection, camera_position, portal, rect, portal_rect)) {
+                continue;
+            }
+            visit(view_projection, camera_position, portal.cells[0] == cell ? portal.cells[1] : portal.cells[0], portal_index,
+                  portal_rect);
+        }
+    }
+
+    // the part of rect the portal covers, false if there is none
+    static bool project(const glm::mat4& view_projection, const glm::vec3& camera_position, const Portal& portal,
+                        const ScreenRect& rect, ScreenRect& result)
+    {
+        std::array<glm::vec4, 4> clip;
+        bool beyond_far_plane = true;
+        bool near_camera = false;
+        for (std::size_t i = 0; i < clip.size(); i++) {
+            clip[i] = view_projection * glm::vec4(portal.corners[i], 1.0f);
+            beyond_far_plane = beyond_far_plane && clip[i].z > clip[i].w;
+            near_camera = near_camera || clip[i].z + clip[i].w < 0.0f;
+        }
+        if (beyond_far_plane) {
+            return false;
+        }
+        // the near plane can cut away all of a portal the camera is passing through, the next cell then fills
+        // the whole rectangle
+        if (near_camera && within(portal, camera_position)) {
+            result = rect;
+            return true;
+        }
+
+        // only the part of the portal in front of the near plane is projected
+        ScreenRect bounds{glm::vec2{std::numeric_limits<float>::max()}, glm::vec2{-std::numeric_limits<float>::max()}};
+        const auto add = [&](const glm::vec4& point) {
+            const glm::vec2 ndc{point.x / point.w, point.y / point.w};
+            bounds.min = glm::min(bounds.min, ndc);
+            bounds.max = glm::max(bounds.max, ndc);
+        };
+        for (std::size_t i = 0; i < clip.size(); i++) {
+            const glm::vec4& a = clip[i];
+            const glm::vec4& b = clip[(i + 1) % clip.size()];
+            const float distance_a = a.z + a.w;
+            const float distance_b = b.z + b.w;
+            if (distance_a >= 0.0f) {
+                add(a);
+            }
+            if ((distance_a >= 0.0f) != (distance_b >= 0.0f)) {
+                add(a + (b - a) * (distance_a / (distance_a - distance_b)));
+            }
+        }
+        result = ScreenRect{glm::max(bounds.min, rect.min), glm::min(bounds.max, rect.max)};
+        return !result.empty();
+    }
+
+    // whether the point lies inside the portal's edges, seen along the portal's normal
+    static bool within(const Portal& portal, const glm::vec3& point)
+    {
+        const auto& corners = portal.corners;
+        const glm::vec3 normal = glm::cross(corners[1] - corners[0], corners[2] - corners[0]);
+        bool inside = true;
+        bool outside = true;
+        for (std::size_t i = 0; i < corners.size(); i++) {
+            const glm::vec3& a = corners[i];
+            const glm::vec3& b = corners[(i + 1) % corners.size()];
+            const float side = glm::dot(glm::cross(b - a, point - a), normal);
+            inside = inside && side >= 0.0f;
+            outside = outside && side <= 0.0f;
+        }
+        return inside || outside;
+    }
+
+    // the frustum whose sides pass through the rectangle's edges, near and far stay
+    static Frustum narrowed_frustum(const glm::mat4& view_projection, const ScreenRect& rect)
+    {
+        const glm::vec2 scale = glm::vec2{2.0f} / (rect.max - rect.min);
+        const glm::vec2 center = (rect.min + rect.max) * 0.5f;
+        glm::mat4 remap(1.0f);
+        remap[0][0] = scale.x;
+        remap[1][1] = scale.y;
+        remap[3][0] = -scale.x * center.x;
+        remap[3][1] = -scale.y * center.y;
+        return Frustum{remap * view_projection};
+    }
+
+    std::vector<std::vector<std::size_t>> m_cell_portals;
+    std::vector<Portal> m_portals;
+    std::vector<VisibleCell> m_visible;
+};
+
+#endif //CYBERPUNK_HALLWAY_PORTALS_H
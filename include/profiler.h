@@ -0,0 +1,152 @@
+//
+// Per-pass profiler: GL_TIME_ELAPSED queries for the GPU time and a steady clock for the CPU time of named
+// sections of a frame. Queries are kept in a ring of frames_in_flight sets and a result is only read back when
+// its set comes around again, by which time the GPU has long finished it, so reading never stalls the pipeline.
+// Time elapsed queries can't nest, so neither can sections.
+//
+
+#ifndef CYBERPUNK_HALLWAY_PROFILER_H
+#define CYBERPUNK_HALLWAY_PROFILER_H
+
+#include <glad/glad.h>
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <string>
+#include <vector>
+
+class Profiler
+{
+public:
+    static constexpr std::size_t frames_in_flight = 3;
+    // samples kept per section for the graphs
+    static constexpr std::size_t history_size = 120;
+
+    using Clock = std::chrono::steady_clock;
+
+    struct Section
+    {
+        std::string name;
+        // latest results in milliseconds, the GPU time lags frames_in_flight - 1 frames behind
+        double gpu_ms{};
+        double cpu_ms{};
+        // GPU times of the last history_size frames, oldest at history_offset
+        std::array<float, history_size> history{};
+        std::size_t history_offset{};
+        // frame the section last ran in, sections not run this frame are shown as idle
+        std::size_t last_frame{};
+
+    private:
+        friend class Profiler;
+        std::array<GLuint, frames_in_flight> queries{};
+        std::array<bool, frames_in_flight> pending{};
+    };
+
+    // ends a section when it goes out of scope
+    class Scope
+    {
+    public:
+        Scope(Profiler& profiler, const char* name)
+            : m_profiler{profiler}
+        {
+            m_profiler.begin(name);
+        }
+
+        Scope(const Scope&) = delete;
+        Scope& operator=(const Scope&) = delete;
+
+        ~Scope()
+        {
+            m_profiler.end();
+        }
+
+    private:
+        Profiler& m_profiler;
+    };
+
+    Profiler() = default;
+    Profiler(const Profiler&) = delete;
+    Profiler& operator=(const Profiler&) = delete;
+
+    ~Profiler()
+    {
+        for (auto& section : m_sections) {
+            glDeleteQueries(static_cast<GLsizei>(section.queries.size()), section.queries.data());
+        }
+    }
+
+    // moves on to the next query set, collecting the results that were recorded in it frames_in_flight frames ago
+    void begin_frame()
+    {
+        m_frame++;
+        m_slot = m_frame % frames_in_flight;
+        for (auto& section : m_sections) {
+            if (!section.pending[m_slot]) {
+                continue;
+            }
+            const GLuint query = section.queries[m_slot];
+            GLint available{};
+            glGetQueryObjectiv(query, GL_QUERY_RESULT_AVAILABLE, &available);
+            if (!available) {
+                // the GPU is more than frames_in_flight frames behind, drop the sample instead of waiting
+                continue;
+            }
+            GLuint64 elapsed{};
+            glGetQueryObjectui64v(query, GL_QUERY_RESULT, &elapsed);
+            section.pending[m_slot] = false;
+            section.gpu_ms = static_cast<double>(elapsed) / 1.0e6;
+            section.history[section.history_offset] = static_cast<float>(section.gpu_ms);
+            section.history_offset = (section.history_offset + 1) % history_size;
+        }
+    }
+
+    [[nodiscard]] Scope scope(const char* name)
+    {
+        return {*this, name};
+    }
+
+    void begin(const char* name)
+    {
+        auto it = std::find_if(m_sections.begin(), m_sections.end(), [&](const Section& s) { return s.name == name; });
+        if (it == m_sections.end()) {
+            Section section;
+            section.name = name;
+            glGenQueries(static_cast<GLsizei>(section.queries.size()), section.queries.data());
+            it = m_sections.insert(m_sections.end(), std::move(section));
+        }
+        m_current = static_cast<std::size_t>(it - m_sections.begin());
+        it->last_frame = m_frame;
+        // a result still pending in this slot is lost, see begin_frame
+        it->pending[m_slot] = true;
+        glBeginQuery(GL_TIME_ELAPSED, it->queries[m_slot]);
+        m_cpu_start = Clock::now();
+    }
+
+    void end()
+    {
+        glEndQuery(GL_TIME_ELAPSED);
+        m_sections[m_current].cpu_ms = std::chrono::duration<double, std::milli>(Clock::now() - m_cpu_start).count();
+    }
+
+    // sections in the order they were first run
+    [[nodiscard]] const std::vector<Section>& sections() const
+    {
+        return m_sections;
+    }
+
+    [[nodiscard]] bool ran_this_frame(const Section& section) const
+    {
+        return section.last_frame == m_frame;
+    }
+
+private:
+    std::vector<Section> m_sections;
+    std::size_t m_frame{};
+    std::size_t m_slot{};
+    std::size_t m_current{};
+    Clock::time_point m_cpu_start;
+};
+
+#endif //CYBERPUNK_HALLWAY_PROFILER_H
@@ -0,0 +1,488 @@
+//
+// Render queue: passes submit draw items (program, material, geometry range, transform) instead of drawing
+// right away, the queue sorts them by a 64 bit key and executes them skipping redundant state changes.
+// Items whose bounds are outside the view frustum or hidden behind the occluders of an OcclusionCuller are
+// dropped when they are submitted. Models are submitted at a level of detail, which every mesh of the model
+// clamps to its coarsest level. Meshes with meshlets are culled further: at the full level, meshlets outside
+// the frustum or facing away from the camera are dropped and the rest is drawn with one glMultiDrawElements.
+// Such items are drawn on their own, items keeping all their meshlets can still be instanced.
+// Opaque items are keyed by program, material and geometry, then front to back depth, so that glUseProgram and
+// texture binds are only issued when they change and the copies of a mesh end up next to each other.
+// Transparent items are keyed by depth only, back to front. Consecutive items drawing the same mesh with the
+// same program and material become one instanced draw, the vertex shaders read the transforms from an
+// instance buffer at attribute locations instance_attribute to instance_attribute + 3.
+//
+// Materials bind their textures to fixed units, which every program's samplers are pointed at when the
+// program is switched to.
+//
+
+#ifndef CYBERPUNK_HALLWAY_RENDER_QUEUE_H
+#define CYBERPUNK_HALLWAY_RENDER_QUEUE_H
+
+#include <glad/glad.h>
+
+#include <glm/glm.hpp>
+
+#include <frustum.h>
+#include <geometry_arena.h>
+#include <learnopengl/mesh_edited.h>
+#include <learnopengl/model_edited.h>
+#include <learnopengl/shader.h>
+#include <material.h>
+#include <occlusion_culler.h>
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <iostream>
+#include <map>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+class RenderQueue
+{
+public:
+    enum class Order
+    {
+        // by state, then front to back, for opaque objects
+        state_then_front_to_back,
+        // back to front only, for blending
+        back_to_front,
+    };
+
+    // first of the four vec4 attributes holding the model matrix of an instance
+    static constexpr GLuint instance_attribute = 5;
+
+    // state changes issued by execute(), and the ones drawing the items one by one in submission order would
+    // have issued
+    struct Statistics
+    {
+        std::size_t draws{};
+        // items drawn, the draw calls without instancing
+        std::size_t instances{};
+        // items outside the frustum, or with all their meshlets culled
+        std::size_t culled{};
+        // items inside the frustum but hidden by occluders
+        std::size_t occluded{};
+        // triangles of the meshes and models drawn, by level of detail
+        std::array<std::size_t, maxLodLevels> lod_triangles{};
+        // meshlets tested, and the ones outside the frustum or facing away
+        std::size_t meshlets{};
+        std::size_t meshlets_culled{};
+        std::size_t program_changes{};
+        std::size_t texture_binds{};
+        std::size_t vertex_array_binds{};
+        std::size_t unsorted_program_changes{};
+        std::size_t unsorted_texture_binds{};
+        std::size_t unsorted_vertex_array_binds{};
+    };
+
+    explicit RenderQueue(const GeometryArena& arena)
+        : m_arena{arena}
+    {
+        glGenBuffers(1, &m_instance_buffer);
+    }
+
+    RenderQueue(const RenderQueue&) = delete;
+    RenderQueue& operator=(const RenderQueue&) = delete;
+
+    ~RenderQueue()
+    {
+        glDeleteBuffers(1, &m_instance_buffer);
+    }
+
+    // starts counting the state changes of a new frame, the last frame's stay readable through statistics()
+    void begin_frame()
+    {
+        m_last_frame = m_frame;
+        m_frame = {};
+    }
+
+    void clear()
+    {
+        m_items.clear();
+        m_part_counts.clear();
+        m_part_offsets.clear();
+        m_part_base_vertices.clear();
+    }
+
+    // items submitted from now on are culled against the frustum, a default constructed one culls nothing
+    void set_frustum(const Frustum& frustum)
+    {
+        m_frustum = frustum;
+    }
+
+    // items submitted from now on are tested against the culler's rasterized occluders, nullptr disables it
+    void set_occlusion_culler(const OcclusionCuller* culler)
+    {
+        m_occlusion_culler = culler;
+    }
+
+    // meshes submitted from now on are culled by meshlet against the frustum and a camera at the position
+    void set_meshlet_culling(bool enabled, const glm::vec3& camera_position)
+    {
+        m_meshlet_culling = enabled;
+        m_camera_position = camera_position;
+    }
+
+    // bounds are the object space bounding box of the geometry. Items outside the frustum or occluded are
+    // dropped and false is returned, the depth is measured at the center of their world space bounds.
+    bool submit(Shader& shader, const Material& material, const GeometryArena::Range& geometry, const glm::mat4& model,
+                const BoundingBox& bounds, const glm::vec3& position_scale = glm::vec3{1.0f}, const glm::vec3& position_offset = glm::vec3{0.0f})
+    {
+        const BoundingBox world_bounds = bounds.transformed(model);
+        if (!m_frustum.intersects(world_bounds)) {
+            m_frame.culled++;
+            return false;
+        }
+        if (m_occlusion_culler && !m_occlusion_culler->visible(world_bounds)) {
+            m_frame.occluded++;
+            return false;
+        }
+        m_items.push_back({0, program_index(shader), material_index(material), geometry_index(geometry), material, geometry, model,
+                           world_bounds.center(), position_scale, position_offset, m_items.size()});
+        return true;
+    }
+
+    void submit(Shader& shader, const Mesh& mesh, const glm::mat4& model, std::size_t lod = 0)
+    {
+        lod = std::min(lod, mesh.lodCount() - 1);
+        const GeometryArena::Range& geometry = mesh.lodGeometry(lod);
+        if (!submit(shader, mesh.material, geometry, model, BoundingBox{mesh.boundsMin, mesh.boundsMax}, mesh.positionScale,
+                    mesh.positionOffset)) {
+            return;
+        }
+        // the coarser levels have no meshlets, they are used where the mesh covers little of the screen anyway
+        const GLsizei index_count = lod == 0 && m_meshlet_culling && !mesh.meshlets.empty() ? cull_meshlets(mesh, model) : geometry.index_count;
+        m_frame.lod_triangles[lod] += static_cast<std::size_t>(index_count) / 3;
+    }
+
+    // the model's bounds are tested first, so a model outside the frustum or occluded costs one test
+    void submit(Shader& shader, const Model& object, const glm::mat4& model, std::size_t lod = 0)
+    {
+        const BoundingBox world_bounds = BoundingBox{object.boundsMin, object.boundsMax}.transformed(model);
+        if (!m_frustum.intersects(world_bounds)) {
+            m_frame.culled += object.meshes.size();
+            return;
+        }
+        if (m_occlusion_culler && !m_occlusion_culler->visible(world_bounds)) {
+            m_frame.occluded += object.meshes.size();
+            return;
+        }
+        for (const Mesh& mesh : object.meshes) {
+            submit(shader, mesh, model, lod);
+        }
+    }
+
+    void sort(const glm::vec3& view_position, Order order)
+    {
+        for (Item& item : m_items) {
+            // the bits of a non-negative float sort like the float
+            const auto depth = std::bit_cast<std::uint32_t>(glm::length(item.center - view_position));
+            if (order == Order::back_to_front) {
+                item.key = ~std::uint64_t{depth} & 0xffffffffull;
+            } else {
+                // 8 bits of program, 20 of material, 20 of geometry and the top 16 of the depth, which keep
+                // 7 bits of mantissa, plenty for front to back
+                item.key = std::uint64_t{item.program} << 56 | std::uint64_t{item.material_index & index_mask} << 36 |
+                           std::uint64_t{item.geometry_index & index_mask} << 16 | depth >> 16;
+            }
+        }
+        std::stable_sort(m_items.begin(), m_items.end(), [](const Item& a, const Item& b) { return a.key < b.key; });
+    }
+
+    // draws the items in their current order. Bindings made outside the queue aren't tracked, so the first item
+    // binds everything again.
+    void execute()
+    {
+        if (m_items.empty()) {
+            return;
+        }
+        m_transforms.clear();
+        for (const Item& item : m_items) {
+            m_transforms.push_back(item.model);
+        }
+        glBindBuffer(GL_ARRAY_BUFFER, m_instance_buffer);
+        glBufferData(GL_ARRAY_BUFFER, static_cast<GLsizeiptr>(m_transforms.size() * sizeof(glm::mat4)), m_transforms.data(), GL_STREAM_DRAW);
+
+        State state;
+        std::vector<const GeometryArena::VertexFormat*> instanced_formats;
+        for (std::size_t first = 0; first < m_items.size();) {
+            const Item& item = m_items[first];
+            std::size_t instances = 1;
+            while (first + instances < m_items.size() && same_draw(item, m_items[first + instances])) {
+                instances++;
+            }
+
+            const Program& program = m_programs[item.program];
+            if (state.change_program(item.program)) {
+                m_frame.program_changes++;
+                program.shader->use();
+                for (std::size_t unit = 0; unit < Material::unit_count; unit++) {
+                    program.shader->setInt(program.samplers[unit], static_cast<int>(unit));
+                }
+            }
+            for (std::size_t unit = 0; unit < Material::unit_count; unit++) {
+                if (state.change_texture(unit, item.material.textures[unit])) {
+                    m_frame.texture_binds++;
+                    glActiveTexture(GL_TEXTURE0 + static_cast<GLenum>(unit));
+                    glBindTexture(GL_TEXTURE_2D, item.material.textures[unit]);
+                }
+            }
+            if (state.change_format(item.geometry.format)) {
+                m_frame.vertex_array_binds++;
+                m_arena.bind(item.geometry.format);
+                if (std::find(instanced_formats.begin(), instanced_formats.end(), item.geometry.format) == instanced_formats.end()) {
+                    instanced_formats.push_back(item.geometry.format);
+                    for (GLuint column = 0; column < 4; column++) {
+                        glEnableVertexAttribArray(instance_attribute + column);
+                        glVertexAttribDivisor(instance_attribute + column, 1);
+                    }
+                }
+            }
+            // GL 3.3 has no base instance, so the attributes are pointed at the batch's transforms instead
+            for (GLuint column = 0; column < 4; column++) {
+                glVertexAttribPointer(instance_attribute + column, 4, GL_FLOAT, GL_FALSE, sizeof(glm::mat4),
+                                      reinterpret_cast<const void*>(first * sizeof(glm::mat4) + column * sizeof(glm::vec4)));
+            }
+            program.shader->setVec3(program.position_scale, item.position_scale);
+            program.shader->setVec3(program.position_offset, item.position_offset);
+            if (item.part_count > 0) {
+                GeometryArena::multi_draw_bound(item.geometry, &m_part_counts[item.first_part], &m_part_offsets[item.first_part],
+                                                &m_part_base_vertices[item.first_part], static_cast<GLsizei>(item.part_count));
+            } else {
+                GeometryArena::draw_bound_instanced(item.geometry, static_cast<GLsizei>(instances));
+            }
+            m_frame.draws++;
+            m_frame.instances += instances;
+            first += instances;
+        }
+
+        // draws outside the queue don't provide instance transforms
+        for (const auto* format : instanced_formats) {
+            m_arena.bind(format);
+            for (GLuint column = 0; column < 4; column++) {
+                glDisableVertexAttribArray(instance_attribute + column);
+            }
+        }
+        glBindVertexArray(0);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+        glActiveTexture(GL_TEXTURE0);
+        count_unsorted();
+    }
+
+    // state changes of the last complete frame
+    [[nodiscard]] const Statistics& statistics() const
+    {
+        return m_last_frame;
+    }
+
+private:
+    // material and geometry numbers get this many bits of the sort key
+    static constexpr int index_bits = 20;
+    static constexpr std::uint32_t index_mask = (1u << index_bits) - 1;
+
+    struct Item
+    {
+        std::uint64_t key;
+        std::uint32_t program;
+        std::uint32_t material_index;
+        std::uint32_t geometry_index;
+        Material material;
+        GeometryArena::Range geometry;
+        glm::mat4 model;
+        glm::vec3 center;
+        glm::vec3 position_scale;
+        glm::vec3 position_offset;
+        // position in submission order, for counting the unsorted state changes
+        std::size_t submission{};
+        // the meshlets left after culling, as parts in m_part_counts and m_part_offsets. None draws the whole geometry
+        std::size_t first_part{};
+        std::size_t part_count{};
+    };
+
+    struct Program
+    {
+        Shader* shader;
+        GLint position_scale;
+        GLint position_offset;
+        std::array<GLint, Material::unit_count> samplers;
+    };
+
+    // currently bound state, unknown until first set
+    struct State
+    {
+        static constexpr unsigned unknown = ~0u;
+        std::uint32_t program{unknown};
+        std::array<unsigned, Material::unit_count> textures{unknown, unknown, unknown, unknown, unknown};
+        const GeometryArena::VertexFormat* format{};
+
+        bool change_program(std::uint32_t value)
+        {
+            return std::exchange(program, value) != value;
+        }
+        bool change_texture(std::size_t unit, unsigned value)
+        {
+            return std::exchange(textures[unit], value) != value;
+        }
+        bool change_format(const GeometryArena::VertexFormat* value)
+        {
+            return std::exchange(format, value) != value;
+        }
+    };
+
+    struct MaterialHash
+    {
+        std::size_t operator()(const Material& material) const
+        {
+            std::size_t hash = 0;
+            for (const unsigned texture : material.textures) {
+                hash ^= std::hash<unsigned>{}(texture) + 0x9e3779b9 + (hash << 6) + (hash >> 2);
+            }
+            return hash;
+        }
+    };
+
+    std::uint32_t program_index(Shader& shader)
+    {
+        for (std::size_t i = 0; i < m_programs.size(); i++) {
+            if (m_programs[i].shader == &shader) {
+                return static_cast<std::uint32_t>(i);
+            }
+        }
+        Program program{&shader, shader.uniformLocation("positionScale"), shader.uniformLocation("positionOffset"), {}};
+        for (std::size_t unit = 0; unit < Material::unit_count; unit++) {
+            program.samplers[unit] = shader.uniformLocation(Material::sampler_names[unit]);
+        }
+        m_programs.push_back(program);
+        return static_cast<std::uint32_t>(m_programs.size() - 1);
+    }
+
+    // materials are numbered in the order they are first seen, the numbers only group equal materials
+    std::uint32_t material_index(const Material& material)
+    {
+        const auto [it, added] = m_materials.try_emplace(material, static_cast<std::uint32_t>(m_materials.size()));
+        if (added) {
+            warn_key_overflow(it->second, "materials");
+        }
+        return it->second;
+    }
+
+    // ranges are numbered in the order they are first seen, like materials
+    std::uint32_t geometry_index(const GeometryArena::Range& geometry)
+    {
+        const auto [it, added] = m_geometries.try_emplace({geometry.format, geometry.index_offset},
+                                                          static_cast<std::uint32_t>(m_geometries.size()));
+        if (added) {
+            warn_key_overflow(it->second, "geometry ranges");
+        }
+        return it->second;
+    }
+
+    // numbers past the key's field share bits with smaller ones, such items are still drawn correctly but
+    // may no longer be grouped
+    static void warn_key_overflow(std::uint32_t index, const char* what)
+    {
+        if (index == index_mask + 1) {
+            std::cout << "Render queue: more than " << index_mask + 1 << " " << what
+                      << ", the opaque sort no longer groups all of them" << std::endl;
+        }
+    }
+
+    static bool same_draw(const Item& a, const Item& b)
+    {
+        return a.program == b.program && a.material_index == b.material_index && a.geometry == b.geometry && a.part_count == 0 &&
+               b.part_count == 0;
+    }
+
+    // culls the meshlets of the last submitted item and returns the number of indices left. The item is dropped
+    // if none are, and keeps drawing the whole geometry if all are.
+    GLsizei cull_meshlets(const Mesh& mesh, const glm::mat4& model)
+    {
+        Item& item = m_items.back();
+        const Frustum frustum = m_frustum.transformed(model);
+        // the cone test needs the camera in object space and assumes the transform keeps angles, as the props' do
+        const glm::vec3 camera{glm::inverse(model) * glm::vec4(m_camera_position, 1.0f)};
+        const std::size_t index_size = item.geometry.index_type == GL_UNSIGNED_SHORT ? 2 : 4;
+        const std::size_t first_part = m_part_counts.size();
+        std::size_t part_end = 0;
+        GLsizei index_count = 0;
+        for (const Meshlet& meshlet : mesh.meshlets) {
+            const glm::vec3 to_center = meshlet.center - camera;
+            const glm::vec3 extent{meshlet.radius};
+            if (glm::dot(to_center, meshlet.coneAxis) >= meshlet.coneCutoff * glm::length(to_center) + meshlet.radius ||
+                !frustum.intersects(BoundingBox{meshlet.center - extent, meshlet.center + extent})) {
+                m_frame.meshlets_culled++;
+                continue;
+            }
+            const std::size_t offset = item.geometry.index_offset + meshlet.firstIndex * index_size;
+            const auto count = static_cast<GLsizei>(meshlet.indexCount);
+            // meshlets next to each other in the index buffer are one part
+            if (m_part_counts.size() > first_part && part_end == offset) {
+                m_part_counts.back() += count;
+            } else {
+                m_part_counts.push_back(count);
+                m_part_offsets.push_back(reinterpret_cast<const void*>(offset));
+                m_part_base_vertices.push_back(item.geometry.base_vertex);
+            }
+            part_end = offset + meshlet.indexCount * index_size;
+            index_count += count;
+        }
+        m_frame.meshlets += mesh.meshlets.size();
+
+        if (index_count == 0) {
+            m_items.pop_back();
+            m_frame.culled++;
+        } else if (index_count < item.geometry.index_count) {
+            item.first_part = first_part;
+            item.part_count = m_part_counts.size() - first_part;
+        } else {
+            m_part_counts.resize(first_part);
+            m_part_offsets.resize(first_part);
+            m_part_base_vertices.resize(first_part);
+        }
+        return index_count;
+    }
+
+    // simulates drawing the items one by one in the order they were submitted
+    void count_unsorted()
+    {
+        m_order.resize(m_items.size());
+        for (std::size_t i = 0; i < m_items.size(); i++) {
+            m_order[m_items[i].submission] = &m_items[i];
+        }
+        State state;
+        for (const Item* item : m_order) {
+            m_frame.unsorted_program_changes += state.change_program(item->program);
+            for (std::size_t unit = 0; unit < Material::unit_count; unit++) {
+                m_frame.unsorted_texture_binds += state.change_texture(unit, item->material.textures[unit]);
+            }
+            m_frame.unsorted_vertex_array_binds += state.change_format(item->geometry.format);
+        }
+    }
+
+    const GeometryArena& m_arena;
+    std::vector<Item> m_items;
+    std::vector<const Item*> m_order;
+    std::vector<Program> m_programs;
+    std::unordered_map<Material, std::uint32_t, MaterialHash> m_materials;
+    std::map<std::pair<const GeometryArena::VertexFormat*, std::size_t>, std::uint32_t> m_geometries;
+    std::vector<glm::mat4> m_transforms;
+    unsigned m_instance_buffer{};
+    Frustum m_frustum;
+    const OcclusionCuller* m_occlusion_culler{};
+    bool m_meshlet_culling{};
+    glm::vec3 m_camera_position{0.0f};
+    // index ranges of the items drawn by parts, for glMultiDrawElementsBaseVertex
+    std::vector<GLsizei> m_part_counts;
+    std::vector<const void*> m_part_offsets;
+    std::vector<GLint> m_part_base_vertices;
+    Statistics m_frame;
+    Statistics m_last_frame;
+};
+
+#endif //CYBERPUNK_HALLWAY_RENDER_QUEUE_H
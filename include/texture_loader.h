@@ -0,0 +1,251 @@
+//
+// Loads textures in two phases: load() names the texture right away and decodes the image on a thread pool,
+// finish() uploads all decoded images on the thread that owns the GL context. Requesting every texture before
+// calling finish() lets the decoding of all images overlap.
+// If tools/cook_textures has written an up to date block compressed DDS file next to an image, that file is
+// uploaded with its mip chain instead.
+//
+
+#ifndef CYBERPUNK_HALLWAY_TEXTURE_LOADER_H
+#define CYBERPUNK_HALLWAY_TEXTURE_LOADER_H
+
+#include <glad/glad.h>
+
+#include <stb_image.h>
+
+#include <dds.h>
+#include <texture_registry.h>
+#include <thread_pool.h>
+
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+#include <filesystem>
+#include <future>
+#include <iostream>
+#include <memory>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+class TextureLoader
+{
+public:
+    struct Options
+    {
+        // sRGB internal format, for color textures
+        bool gamma_correction = false;
+        // flip rows so the first row is the bottom of the image, as OpenGL expects
+        bool flip_vertically = false;
+        // channels to decode to, 0 keeps the channels of the file
+        int channels = 0;
+        // throw from finish() if the image can't be loaded, otherwise the failure is only reported
+        bool required = false;
+    };
+
+    explicit TextureLoader(ThreadPool& pool)
+        : m_pool{pool}
+    {
+        // the flag is global in this version of stb_image, so workers never flip and decode() does it instead
+        stbi_set_flip_vertically_on_load(false);
+
+        GLint extension_count{};
+        glGetIntegerv(GL_NUM_EXTENSIONS, &extension_count);
+        for (GLint i = 0; i < extension_count; i++) {
+            const auto* extension = reinterpret_cast<const char*>(glGetStringi(GL_EXTENSIONS, static_cast<GLuint>(i)));
+            if (std::strcmp(extension, "GL_EXT_texture_compression_s3tc") == 0) {
+                m_formats.s3tc = true;
+            } else if (std::strcmp(extension, "GL_EXT_texture_sRGB") == 0) {
+                m_formats.s3tc_srgb = true;
+            }
+        }
+        // sRGB S3TC formats need both extensions
+        m_formats.s3tc_srgb = m_formats.s3tc_srgb && m_formats.s3tc;
+    }
+
+    TextureLoader(const TextureLoader&) = delete;
+    TextureLoader& operator=(const TextureLoader&) = delete;
+
+    // returns the texture, its image is uploaded by finish(). Textures already in the TextureRegistry
+    // are shared instead of loaded again.
+    TextureHandle load(const std::string& path, const Options& options)
+    {
+        auto& registry = TextureRegistry::instance();
+        const TextureRegistry::Key key{path, options.gamma_correction, options.flip_vertically, options.channels};
+        if (auto texture = registry.find(key)) {
+            return texture;
+        }
+
+        unsigned texture{};
+        glGenTextures(1, &texture);
+        m_pending.push_back({texture, path, options, m_pool.submit([path, options, formats = m_formats] { return decode(path, options, formats); })});
+        return registry.add(key, texture);
+    }
+
+    // waits for the decoding of all requested textures and uploads them, must be called on the context thread
+    void finish()
+    {
+        for (auto& request : m_pending) {
+            const auto image = request.image.get();
+            if (!image) {
+                if (request.options.required) {
+                    m_pending.clear();
+                    throw std::runtime_error("Can't load texture " + request.path);
+                }
+                std::cout << "Texture failed to load at path: " << request.path << std::endl;
+                continue;
+            }
+            TextureRegistry::instance().set_resident_bytes(request.texture, upload(request.texture, *image, request.options));
+            std::cout << "Loaded texture " << request.path << (image->compressed ? " (cooked)" : "") << std::endl;
+        }
+        m_pending.clear();
+    }
+
+private:
+    // compressed formats the context can sample, BC5 (RGTC) is core
+    struct CompressedFormats
+    {
+        bool s3tc{};
+        bool s3tc_srgb{};
+    };
+
+    struct Image
+    {
+        int width{};
+        int height{};
+        int channels{};
+        std::unique_ptr<stbi_uc, decltype(&stbi_image_free)> data{nullptr, stbi_image_free};
+        // set instead of data when a cooked file is used
+        std::optional<dds::Image> compressed;
+    };
+
+    struct Request
+    {
+        unsigned texture;
+        std::string path;
+        Options options;
+        std::future<std::shared_ptr<Image>> image;
+    };
+
+    // the cooked version of an image if it exists, is at least as new as the image and can be sampled
+    static std::optional<dds::Image> load_cooked(const std::string& path, const Options& options, CompressedFormats formats)
+    {
+        namespace fs = std::filesystem;
+        const std::string cooked_path = path + (options.flip_vertically ? ".flipped.dds" : ".dds");
+        std::error_code error;
+        const auto cooked_time = fs::last_write_time(cooked_path, error);
+        if (error) {
+            return std::nullopt;
+        }
+        // the source image may be missing, then the cooked file is all there is
+        const auto source_time = fs::last_write_time(path, error);
+        if (!error && source_time > cooked_time) {
+            return std::nullopt;
+        }
+        auto image = dds::read(cooked_path);
+        if (!image || (image->format != dds::bc5 && !(options.gamma_correction ? formats.s3tc_srgb : formats.s3tc))) {
+            return std::nullopt;
+        }
+        return image;
+    }
+
+    // runs on the workers, returns nullptr if the file can't be decoded
+    static std::shared_ptr<Image> decode(const std::string& path, const Options& options, CompressedFormats formats)
+    {
+        auto image = std::make_shared<Image>();
+        if ((image->compressed = load_cooked(path, options, formats))) {
+            return image;
+        }
+        int file_channels{};
+        image->data.reset(stbi_load(path.c_str(), &image->width, &image->height, &file_channels, options.channels));
+        if (!image->data) {
+            return nullptr;
+        }
+        image->channels = options.channels ? options.channels : file_channels;
+
+        if (options.flip_vertically) {
+            const auto row_size = static_cast<std::size_t>(image->width) * image->channels;
+            std::vector<stbi_uc> row(row_size);
+            stbi_uc* data = image->data.get();
+            for (int y = 0; y < image->height / 2; y++) {
+                stbi_uc* top = data + static_cast<std::size_t>(y) * row_size;
+                stbi_uc* bottom = data + static_cast<std::size_t>(image->height - 1 - y) * row_size;
+                std::memcpy(row.data(), top, row_size);
+                std::memcpy(top, bottom, row_size);
+                std::memcpy(bottom, row.data(), row_size);
+            }
+        }
+        return image;
+    }
+
+    // returns the video memory used by the texture
+    static std::size_t upload(unsigned texture, const Image& image, const Options& options)
+    {
+        glBindTexture(GL_TEXTURE_2D, texture);
+        set_parameters();
+        if (image.compressed) {
+            const auto& compressed = *image.compressed;
+            const GLenum format = dds::gl_format(compressed.format, options.gamma_correction);
+            auto width = static_cast<GLsizei>(compressed.width);
+            auto height = static_cast<GLsizei>(compressed.height);
+            std::size_t bytes = 0;
+            for (std::size_t level = 0; level < compressed.levels.size(); level++) {
+                const auto& data = compressed.levels[level];
+                glCompressedTexImage2D(GL_TEXTURE_2D, static_cast<GLint>(level), format, width, height, 0,
+                                       static_cast<GLsizei>(data.size()), data.data());
+                bytes += data.size();
+                width = std::max(width / 2, 1);
+                height = std::max(height / 2, 1);
+            }
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, static_cast<GLint>(compressed.levels.size()) - 1);
+            glBindTexture(GL_TEXTURE_2D, 0);
+            return bytes;
+        }
+
+        GLint internal_format{};
+        GLenum format{};
+        switch (image.channels) {
+        case 1:
+            internal_format = GL_RED;
+            format = GL_RED;
+            break;
+        case 2:
+            internal_format = GL_RG;
+            format = GL_RG;
+            break;
+        case 3:
+            internal_format = options.gamma_correction ? GL_SRGB : GL_RGB;
+            format = GL_RGB;
+            break;
+        default:
+            internal_format = options.gamma_correction ? GL_SRGB_ALPHA : GL_RGBA;
+            format = GL_RGBA;
+            break;
+        }
+
+        // rows of 1 and 3 channel images aren't necessarily 4 byte aligned
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+        glTexImage2D(GL_TEXTURE_2D, 0, internal_format, image.width, image.height, 0, format, GL_UNSIGNED_BYTE, image.data.get());
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+        glGenerateMipmap(GL_TEXTURE_2D);
+        glBindTexture(GL_TEXTURE_2D, 0);
+        // drivers pad 3 channel texels to 4 bytes, the mip chain adds a third
+        const std::size_t texel_size = image.channels == 3 ? 4 : static_cast<std::size_t>(image.channels);
+        return static_cast<std::size_t>(image.width) * image.height * texel_size * 4 / 3;
+    }
+
+    static void set_parameters()
+    {
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    }
+
+    ThreadPool& m_pool;
+    CompressedFormats m_formats;
+    std::vector<Request> m_pending;
+};
+
+#endif //CYBERPUNK_HALLWAY_TEXTURE_LOADER_H
@@ -0,0 +1,195 @@
+//
+// Process-wide registry of loaded textures. Textures are keyed on the canonical path of their image and the
+// way it was loaded (color space, orientation, channels), so an image referenced from several models or from
+// the hallway is only loaded once. Textures are reference counted through TextureHandle and deleted when
+// the last handle goes away. Only use it on the thread that owns the GL context.
+//
+
+#ifndef CYBERPUNK_HALLWAY_TEXTURE_REGISTRY_H
+#define CYBERPUNK_HALLWAY_TEXTURE_REGISTRY_H
+
+#include <glad/glad.h>
+
+#include <cstddef>
+#include <filesystem>
+#include <functional>
+#include <string>
+#include <unordered_map>
+#include <utility>
+
+// shared ownership of a registered texture
+class TextureHandle
+{
+public:
+    TextureHandle() = default;
+    TextureHandle(const TextureHandle& other);
+    TextureHandle(TextureHandle&& other) noexcept
+        : m_texture{std::exchange(other.m_texture, 0)}
+    {
+    }
+    TextureHandle& operator=(TextureHandle other) noexcept
+    {
+        std::swap(m_texture, other.m_texture);
+        return *this;
+    }
+    ~TextureHandle();
+
+    [[nodiscard]] unsigned id() const
+    {
+        return m_texture;
+    }
+
+    explicit operator bool() const
+    {
+        return m_texture != 0;
+    }
+
+private:
+    friend class TextureRegistry;
+    // takes over a reference the registry already counted
+    explicit TextureHandle(unsigned texture)
+        : m_texture{texture}
+    {
+    }
+
+    unsigned m_texture{};
+};
+
+class TextureRegistry
+{
+public:
+    struct Key
+    {
+        std::string path;
+        bool srgb{};
+        bool flipped{};
+        int channels{};
+
+        bool operator==(const Key&) const = default;
+    };
+
+    struct Statistics
+    {
+        std::size_t hits{};
+        std::size_t misses{};
+        std::size_t textures{};
+        std::size_t resident_bytes{};
+    };
+
+    static TextureRegistry& instance()
+    {
+        static TextureRegistry registry;
+        return registry;
+    }
+
+    TextureRegistry(const TextureRegistry&) = delete;
+    TextureRegistry& operator=(const TextureRegistry&) = delete;
+
+    // the registered texture for the image, or an empty handle if it isn't loaded yet
+    TextureHandle find(const Key& key)
+    {
+        const auto it = m_textures.find(canonical(key));
+        if (it == m_textures.end()) {
+            return {};
+        }
+        m_statistics.hits++;
+        m_entries[it->second].references++;
+        return TextureHandle{it->second};
+    }
+
+    // registers a newly created texture, the registry deletes it when the last handle is gone
+    TextureHandle add(const Key& key, unsigned texture)
+    {
+        m_statistics.misses++;
+        m_statistics.textures++;
+        auto canonical_key = canonical(key);
+        m_textures.emplace(canonical_key, texture);
+        m_entries.emplace(texture, Entry{std::move(canonical_key), 1, 0});
+        return TextureHandle{texture};
+    }
+
+    // video memory used by the texture, reported once its image is uploaded
+    void set_resident_bytes(unsigned texture, std::size_t bytes)
+    {
+        const auto it = m_entries.find(texture);
+        if (it != m_entries.end()) {
+            m_statistics.resident_bytes += bytes - it->second.bytes;
+            it->second.bytes = bytes;
+        }
+    }
+
+    [[nodiscard]] const Statistics& statistics() const
+    {
+        return m_statistics;
+    }
+
+private:
+    friend class TextureHandle;
+
+    struct KeyHash
+    {
+        std::size_t operator()(const Key& key) const
+        {
+            std::size_t hash = std::hash<std::string>{}(key.path);
+            hash ^= std::hash<int>{}(key.channels << 2 | key.flipped << 1 | key.srgb) + 0x9e3779b9 + (hash << 6) + (hash >> 2);
+            return hash;
+        }
+    };
+
+    struct Entry
+    {
+        Key key;
+        std::size_t references;
+        std::size_t bytes;
+    };
+
+    TextureRegistry() = default;
+
+    static Key canonical(Key key)
+    {
+        std::error_code error;
+        auto path = std::filesystem::weakly_canonical(key.path, error);
+        key.path = (error ? std::filesystem::path(key.path).lexically_normal() : path).string();
+        return key;
+    }
+
+    void acquire(unsigned texture)
+    {
+        m_entries.at(texture).references++;
+    }
+
+    void release(unsigned texture)
+    {
+        const auto it = m_entries.find(texture);
+        if (it == m_entries.end() || --it->second.references > 0) {
+            return;
+        }
+        glDeleteTextures(1, &texture);
+        m_statistics.textures--;
+        m_statistics.resident_bytes -= it->second.bytes;
+        m_textures.erase(it->second.key);
+        m_entries.erase(it);
+    }
+
+    // key -> texture and texture -> entry, both O(1)
+    std::unordered_map<Key, unsigned, KeyHash> m_textures;
+    std::unordered_map<unsigned, Entry> m_entries;
+    Statistics m_statistics;
+};
+
+inline TextureHandle::TextureHandle(const TextureHandle& other)
+    : m_texture{other.m_texture}
+{
+    if (m_texture) {
+        TextureRegistry::instance().acquire(m_texture);
+    }
+}
+
+inline TextureHandle::~TextureHandle()
+{
+    if (m_texture) {
+        TextureRegistry::instance().release(m_texture);
+    }
+}
+
+#endif //CYBERPUNK_HALLWAY_TEXTURE_REGISTRY_H
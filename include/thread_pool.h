@@ -0,0 +1,93 @@
+//
+// Fixed size pool of worker threads running submitted tasks in FIFO order.
+//
+
+#ifndef CYBERPUNK_HALLWAY_THREAD_POOL_H
+#define CYBERPUNK_HALLWAY_THREAD_POOL_H
+
+#include <algorithm>
+#include <condition_variable>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+class ThreadPool
+{
+public:
+    // one worker per hardware thread by default
+    explicit ThreadPool(unsigned thread_count = std::max(1u, std::thread::hardware_concurrency()))
+    {
+        m_workers.reserve(thread_count);
+        for (unsigned i = 0; i < thread_count; i++) {
+            m_workers.emplace_back([this] { work(); });
+        }
+    }
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    // finishes the queued tasks before returning
+    ~ThreadPool()
+    {
+        {
+            std::lock_guard lock{m_mutex};
+            m_stopping = true;
+        }
+        m_condition.notify_all();
+        for (auto& worker : m_workers) {
+            worker.join();
+        }
+    }
+
+    // runs the task on a worker, the future holds its result or the exception it threw
+    template <class F>
+    auto submit(F&& task) -> std::future<std::invoke_result_t<std::decay_t<F>>>
+    {
+        using Result = std::invoke_result_t<std::decay_t<F>>;
+        // std::function needs a copyable target, so the task is shared
+        auto packaged = std::make_shared<std::packaged_task<Result()>>(std::forward<F>(task));
+        auto future = packaged->get_future();
+        {
+            std::lock_guard lock{m_mutex};
+            m_tasks.emplace([packaged] { (*packaged)(); });
+        }
+        m_condition.notify_one();
+        return future;
+    }
+
+    [[nodiscard]] std::size_t size() const
+    {
+        return m_workers.size();
+    }
+
+private:
+    void work()
+    {
+        while (true) {
+            std::function<void()> task;
+            {
+                std::unique_lock lock{m_mutex};
+                m_condition.wait(lock, [this] { return m_stopping || !m_tasks.empty(); });
+                if (m_tasks.empty()) {
+                    return;
+                }
+                task = std::move(m_tasks.front());
+                m_tasks.pop();
+            }
+            task();
+        }
+    }
+
+    std::vector<std::thread> m_workers;
+    std::queue<std::function<void()>> m_tasks;
+    std::mutex m_mutex;
+    std::condition_variable m_condition;
+    bool m_stopping{};
+};
+
+#endif //CYBERPUNK_HALLWAY_THREAD_POOL_H
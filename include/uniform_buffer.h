@@ -0,0 +1,64 @@
+//
+// Uniform buffer object bound to a fixed binding point, shared by every shader program
+// that declares a uniform block bound to the same point (see Shader::bindUniformBlock)
+//
+
+#ifndef CYBERPUNK_HALLWAY_UNIFORM_BUFFER_H
+#define CYBERPUNK_HALLWAY_UNIFORM_BUFFER_H
+
+#include <glad/glad.h>
+
+#include <algorithm>
+#include <cstddef>
+#include <type_traits>
+
+class UniformBuffer
+{
+public:
+    UniformBuffer(std::size_t size, unsigned binding)
+        : m_size{size}, m_binding{binding}
+    {
+        glGenBuffers(1, &m_UBO);
+        glBindBuffer(GL_UNIFORM_BUFFER, m_UBO);
+        glBufferData(GL_UNIFORM_BUFFER, static_cast<GLsizeiptr>(m_size), nullptr, GL_DYNAMIC_DRAW);
+        glBindBuffer(GL_UNIFORM_BUFFER, 0);
+        glBindBufferBase(GL_UNIFORM_BUFFER, m_binding, m_UBO);
+    }
+
+    UniformBuffer(const UniformBuffer&) = delete;
+    UniformBuffer& operator=(const UniformBuffer&) = delete;
+
+    ~UniformBuffer()
+    {
+        glDeleteBuffers(1, &m_UBO);
+    }
+
+    // replaces the buffer contents, orphaning the old storage so the driver doesn't wait on draws still reading it
+    template <class T>
+    void update(const T& data)
+    {
+        static_assert(std::is_trivially_copyable_v<T>);
+        update(&data, sizeof(T));
+    }
+
+    // replaces the first size bytes of the buffer, the rest of the buffer is left undefined
+    void update(const void* data, std::size_t size) // NOLINT(*-make-member-function-const): Changes buffer contents
+    {
+        glBindBuffer(GL_UNIFORM_BUFFER, m_UBO);
+        glBufferData(GL_UNIFORM_BUFFER, static_cast<GLsizeiptr>(m_size), nullptr, GL_DYNAMIC_DRAW);
+        glBufferSubData(GL_UNIFORM_BUFFER, 0, static_cast<GLsizeiptr>(std::min(size, m_size)), data);
+        glBindBuffer(GL_UNIFORM_BUFFER, 0);
+    }
+
+    [[nodiscard]] unsigned binding() const
+    {
+        return m_binding;
+    }
+
+private:
+    std::size_t m_size;
+    unsigned m_binding;
+    unsigned m_UBO{};
+};
+
+#endif //CYBERPUNK_HALLWAY_UNIFORM_BUFFER_H
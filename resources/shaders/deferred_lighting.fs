@@ -0,0 +1,104 @@
+#version 330 core
+out vec4 FragColor;
+
+#define MAX_LIGHTS 256
+
+in VS_OUT {
+    vec2 TexCoords;
+} fs_in;
+
+// G-buffer
+uniform sampler2D texture_diffuse1; // albedo, specular intensity in alpha
+uniform sampler2D texture_normal1; // world space normal
+uniform sampler2D texture_height1; // depth
+uniform sampler2D texture_emission1;
+
+layout (std140) uniform Frame {
+    mat4 view;
+    mat4 projection;
+    vec4 viewPos;
+    int lightCount;
+    // light clusters: tiles per pixel in x and y, scale and bias from log(view depth) to depth slice
+    vec4 clusterScale;
+    ivec4 clusterGrid;
+};
+
+struct Light {
+    vec3 position;
+    float constant;
+
+    vec3 ambient;
+    float linear;
+
+    vec3 diffuse;
+    float quadratic;
+
+    vec3 specular;
+    float radius;
+};
+
+layout (std140) uniform Lights {
+    Light lights[MAX_LIGHTS];
+};
+
+// (offset, count) of each cluster's range in lightIndices
+uniform usamplerBuffer lightGrid;
+uniform usamplerBuffer lightIndices;
+
+uniform float shininess;
+uniform mat4 inverseViewProjection;
+
+uvec2 ClusterLights(vec3 fragPos)
+{
+    float viewDepth = -(view * vec4(fragPos, 1.0)).z;
+    ivec3 cluster = ivec3(ivec2(gl_FragCoord.xy * clusterScale.xy), int(log(viewDepth) * clusterScale.z + clusterScale.w));
+    cluster = clamp(cluster, ivec3(0), clusterGrid.xyz - 1);
+    return texelFetch(lightGrid, cluster.x + clusterGrid.x * (cluster.y + clusterGrid.y * cluster.z)).rg;
+}
+
+vec3 BlinnPhong(Light light, vec3 fragPos, vec3 normal, vec3 viewDir, vec3 albedo, float specularStrength)
+{
+    vec3 lightDir = normalize(light.position - fragPos);
+
+    vec3 ambient = light.ambient * albedo;
+
+    vec3 diffuse = light.diffuse * max(dot(normal, lightDir), 0.0) * albedo;
+
+    vec3 halfwayDir = normalize(lightDir + viewDir);
+    vec3 specular = light.specular * pow(max(dot(normal, halfwayDir), 0.0), shininess) * specularStrength;
+
+    float distance = length(light.position - fragPos);
+    float attenuation = 1.0 / (light.constant + light.linear * distance + light.quadratic * (distance * distance));
+    // fade out towards the culling radius so the light doesn't end with a visible edge
+    float window = clamp(1.0 - pow(distance / light.radius, 4.0), 0.0, 1.0);
+    attenuation *= window * window;
+
+    return (ambient + diffuse + specular) * attenuation;
+}
+
+void main()
+{
+    float depth = texture(texture_height1, fs_in.TexCoords).r;
+    // nothing was drawn here, keep the clear color
+    if (depth == 1.0)
+        discard;
+
+    // reconstruct the world space position from depth
+    vec4 position = inverseViewProjection * vec4(vec3(fs_in.TexCoords, depth) * 2.0 - 1.0, 1.0);
+    vec3 fragPos = position.xyz / position.w;
+
+    vec4 albedoSpecular = texture(texture_diffuse1, fs_in.TexCoords);
+    vec3 normal = normalize(texture(texture_normal1, fs_in.TexCoords).xyz);
+    vec3 viewDir = normalize(viewPos.xyz - fragPos);
+
+    vec3 color = vec3(0.0, 0.0, 0.0);
+    uvec2 clusterLights = ClusterLights(fragPos);
+    for (uint i = 0u; i < clusterLights.y; i++) {
+        int light = int(texelFetch(lightIndices, int(clusterLights.x + i)).r);
+        color += BlinnPhong(lights[light], fragPos, normal, viewDir, albedoSpecular.rgb, albedoSpecular.a);
+    }
+
+    color += texture(texture_emission1, fs_in.TexCoords).rgb;
+
+    FragColor = vec4(color, 1.0);
+}
\ No newline at end of file
@@ -0,0 +1,25 @@
+#version 330 core
+layout (location = 0) in vec3 aPos;
+layout (location = 5) in mat4 model;
+
+layout (std140) uniform Frame {
+    mat4 view;
+    mat4 projection;
+    vec4 viewPos;
+    int lightCount;
+    // light clusters: tiles per pixel in x and y, scale and bias from log(view depth) to depth slice
+    vec4 clusterScale;
+    ivec4 clusterGrid;
+};
+
+uniform vec3 positionScale;
+uniform vec3 positionOffset;
+
+// must produce bit-identical depth to shader.vs for the color pass to pass the depth test
+invariant gl_Position;
+
+void main()
+{
+    vec3 fragPos = vec3(model * vec4(positionOffset + positionScale * aPos, 1.0));
+    gl_Position = projection * view * vec4(fragPos, 1.0);
+}
@@ -0,0 +1,74 @@
+#version 330 core
+layout (location = 0) out vec4 gAlbedoSpecular;
+layout (location = 1) out vec4 gNormal;
+layout (location = 2) out vec4 gEmission;
+
+in VS_OUT {
+    vec3 FragPos;
+    vec2 TexCoords;
+    mat3 TBN;
+} fs_in;
+
+uniform sampler2D texture_diffuse1;
+uniform sampler2D texture_specular1;
+uniform sampler2D texture_normal1;
+uniform sampler2D texture_height1;
+uniform sampler2D texture_emission1;
+
+layout (std140) uniform Frame {
+    mat4 view;
+    mat4 projection;
+    vec4 viewPos;
+    int lightCount;
+    // light clusters: tiles per pixel in x and y, scale and bias from log(view depth) to depth slice
+    vec4 clusterScale;
+    ivec4 clusterGrid;
+};
+
+uniform float heightScale;
+uniform float minLayers;
+uniform float maxLayers;
+
+vec2 ParallaxMapping(vec2 texCoords, vec3 viewDir)
+{
+    float numLayers = mix(maxLayers, minLayers, max(dot(vec3(0.0, 0.0, 1.0), viewDir), 0.0));
+    float layerDepth = 1.0 / numLayers;
+    vec2 deltaTexCoords = viewDir.xy * heightScale / numLayers;
+
+    float currentLayerDepth = 0.0;
+    vec2  currentTexCoords = texCoords;
+    float currentDepthMapValue = texture(texture_height1, currentTexCoords).r;
+
+    while(currentLayerDepth < currentDepthMapValue)
+    {
+        currentTexCoords -= deltaTexCoords;
+        currentDepthMapValue = 1.0 - texture(texture_height1, currentTexCoords).r;
+        currentLayerDepth += layerDepth;
+    }
+
+    vec2 prevTexCoords = currentTexCoords + deltaTexCoords;
+
+    float afterDepth  = currentDepthMapValue - currentLayerDepth;
+    float beforeDepth = 1.0 - texture(texture_height1, prevTexCoords).r - currentLayerDepth + layerDepth;
+
+    float weight = afterDepth / (afterDepth - beforeDepth);
+    vec2 finalTexCoords = prevTexCoords * weight + currentTexCoords * (1.0 - weight);
+
+    return finalTexCoords;
+}
+
+void main()
+{
+    vec3 viewDir = normalize(viewPos.xyz - fs_in.FragPos);
+    // parallax mapping works with the view direction in tangent space
+    vec2 texCoords = ParallaxMapping(fs_in.TexCoords, normalize(transpose(fs_in.TBN) * viewDir));
+
+    // cooked normal maps only store x and y (BC5), so z is always reconstructed
+    vec2 normalXY = texture(texture_normal1, texCoords).rg * 2.0 - 1.0;
+    vec3 normal = vec3(normalXY, sqrt(max(1.0 - dot(normalXY, normalXY), 0.0)));
+    normal = normalize(fs_in.TBN * normal);
+
+    gAlbedoSpecular = vec4(texture(texture_diffuse1, texCoords).rgb, texture(texture_specular1, texCoords).r);
+    gNormal = vec4(normal, 0.0);
+    gEmission = vec4(texture(texture_emission1, texCoords).rgb, 1.0);
+}
\ No newline at end of file
@@ -0,0 +1,22 @@
+#version 330 core
+layout (location = 0) out vec4 gAlbedoSpecular;
+layout (location = 1) out vec4 gNormal;
+layout (location = 2) out vec4 gEmission;
+
+in VS_OUT {
+    vec3 FragPos;
+    vec2 TexCoords;
+    mat3 TBN;
+} fs_in;
+
+uniform sampler2D texture_diffuse1;
+uniform sampler2D texture_specular1;
+
+void main()
+{
+    vec2 texCoords = fs_in.TexCoords;
+
+    gAlbedoSpecular = vec4(texture(texture_diffuse1, texCoords).rgb, texture(texture_specular1, texCoords).r);
+    gNormal = vec4(normalize(fs_in.TBN[2]), 0.0);
+    gEmission = vec4(0.0, 0.0, 0.0, 1.0);
+}
\ No newline at end of file
@@ -1,37 +1,63 @@
 #version 330 core
 out vec4 FragColor;
 
-#define NUM_LIGHTS 2
+#define MAX_LIGHTS 256
 
 in VS_OUT {
     vec3 FragPos;
     vec2 TexCoords;
-    vec3 ViewPos;
-    vec3 LightPos[NUM_LIGHTS];
+    mat3 TBN;
 } fs_in;
 
 uniform sampler2D texture_diffuse1;
 uniform sampler2D texture_specular1;
 uniform sampler2D texture_emission1;
 
+layout (std140) uniform Frame {
+    mat4 view;
+    mat4 projection;
+    vec4 viewPos;
+    int lightCount;
+    // light clusters: tiles per pixel in x and y, scale and bias from log(view depth) to depth slice
+    vec4 clusterScale;
+    ivec4 clusterGrid;
+};
+
 struct Light {
     vec3 position;
+    float constant;
 
     vec3 ambient;
+    float linear;
+
     vec3 diffuse;
+    float quadratic;
+
     vec3 specular;
+    float radius;
+};
 
-    float constant;
-    float linear;
-    float quadratic;
+layout (std140) uniform Lights {
+    Light lights[MAX_LIGHTS];
 };
 
+// (offset, count) of each cluster's range in lightIndices
+uniform usamplerBuffer lightGrid;
+uniform usamplerBuffer lightIndices;
+
 uniform float shininess;
-uniform Light lights[NUM_LIGHTS];
 
-vec3 BlinnPhong(Light light, vec3 normal, vec3 viewDir, vec2 texCoords, vec3 lightPos)
+uvec2 ClusterLights()
+{
+    float viewDepth = -(view * vec4(fs_in.FragPos, 1.0)).z;
+    ivec3 cluster = ivec3(ivec2(gl_FragCoord.xy * clusterScale.xy), int(log(viewDepth) * clusterScale.z + clusterScale.w));
+    cluster = clamp(cluster, ivec3(0), clusterGrid.xyz - 1);
+    return texelFetch(lightGrid, cluster.x + clusterGrid.x * (cluster.y + clusterGrid.y * cluster.z)).rg;
+}
+
+vec3 BlinnPhong(Light light, vec3 normal, vec3 viewDir, vec2 texCoords)
 {
-    vec3 lightDir = normalize(lightPos  - fs_in.FragPos);
+    vec3 lightDir = normalize(light.position - fs_in.FragPos);
 
     vec3 ambient = light.ambient * vec3(texture(texture_diffuse1, texCoords));
 
@@ -41,22 +67,27 @@ vec3 BlinnPhong(Light light, vec3 normal, vec3 viewDir, vec2 texCoords, vec3 lig
     vec3 specular = light.specular * pow(max(dot(normal, halfwayDir), 0.0), shininess)
             * texture(texture_specular1, texCoords).xxx;
 
-    float distance = length(lightPos - fs_in.FragPos);
+    float distance = length(light.position - fs_in.FragPos);
     float attenuation = 1.0 / (light.constant + light.linear * distance + light.quadratic * (distance * distance));
+    // fade out towards the culling radius so the light doesn't end with a visible edge
+    float window = clamp(1.0 - pow(distance / light.radius, 4.0), 0.0, 1.0);
+    attenuation *= window * window;
 
     return (ambient + diffuse + specular) * attenuation;
 }
 
 void main()
 {
-    vec3 viewDir = normalize(fs_in.ViewPos - fs_in.FragPos);
+    vec3 viewDir = normalize(viewPos.xyz - fs_in.FragPos);
     vec2 texCoords = fs_in.TexCoords;
 
-    vec3 normal = vec3(0.0, 0.0, 1.0);
+    vec3 normal = normalize(fs_in.TBN[2]);
 
     vec3 color = vec3(0.0, 0.0, 0.0);
-    for (int i = 0; i < NUM_LIGHTS; i++) {
-        color += BlinnPhong(lights[i], normal, viewDir, texCoords, fs_in.LightPos[i]);
+    uvec2 clusterLights = ClusterLights();
+    for (uint i = 0u; i < clusterLights.y; i++) {
+        int light = int(texelFetch(lightIndices, int(clusterLights.x + i)).r);
+        color += BlinnPhong(lights[light], normal, viewDir, texCoords);
     }
 
     float alpha = texture(texture_diffuse1, texCoords).a;
@@ -1,13 +1,12 @@
 #version 330 core
 out vec4 FragColor;
 
-#define NUM_LIGHTS 2
+#define MAX_LIGHTS 256
 
 in VS_OUT {
     vec3 FragPos;
     vec2 TexCoords;
-    vec3 ViewPos;
-    vec3 LightPos[NUM_LIGHTS];
+    mat3 TBN;
 } fs_in;
 
 uniform sampler2D texture_diffuse1;
@@ -16,20 +15,39 @@ uniform sampler2D texture_normal1;
 uniform sampler2D texture_height1;
 uniform sampler2D texture_emission1;
 
+layout (std140) uniform Frame {
+    mat4 view;
+    mat4 projection;
+    vec4 viewPos;
+    int lightCount;
+    // light clusters: tiles per pixel in x and y, scale and bias from log(view depth) to depth slice
+    vec4 clusterScale;
+    ivec4 clusterGrid;
+};
+
 struct Light {
     vec3 position;
+    float constant;
 
     vec3 ambient;
+    float linear;
+
     vec3 diffuse;
+    float quadratic;
+
     vec3 specular;
+    float radius;
+};
 
-    float constant;
-    float linear;
-    float quadratic;
+layout (std140) uniform Lights {
+    Light lights[MAX_LIGHTS];
 };
 
+// (offset, count) of each cluster's range in lightIndices
+uniform usamplerBuffer lightGrid;
+uniform usamplerBuffer lightIndices;
+
 uniform float shininess;
-uniform Light lights[NUM_LIGHTS];
 uniform float heightScale;
 uniform float minLayers;
 uniform float maxLayers;
@@ -62,9 +80,17 @@ vec2 ParallaxMapping(vec2 texCoords, vec3 viewDir)
     return finalTexCoords;
 }
 
-vec3 BlinnPhong(Light light, vec3 normal, vec3 viewDir, vec2 texCoords, vec3 lightPos)
+uvec2 ClusterLights()
+{
+    float viewDepth = -(view * vec4(fs_in.FragPos, 1.0)).z;
+    ivec3 cluster = ivec3(ivec2(gl_FragCoord.xy * clusterScale.xy), int(log(viewDepth) * clusterScale.z + clusterScale.w));
+    cluster = clamp(cluster, ivec3(0), clusterGrid.xyz - 1);
+    return texelFetch(lightGrid, cluster.x + clusterGrid.x * (cluster.y + clusterGrid.y * cluster.z)).rg;
+}
+
+vec3 BlinnPhong(Light light, vec3 normal, vec3 viewDir, vec2 texCoords)
 {
-    vec3 lightDir = normalize(lightPos  - fs_in.FragPos);
+    vec3 lightDir = normalize(light.position - fs_in.FragPos);
 
     vec3 ambient = light.ambient * vec3(texture(texture_diffuse1, texCoords));
 
@@ -74,23 +100,31 @@ vec3 BlinnPhong(Light light, vec3 normal, vec3 viewDir, vec2 texCoords, vec3 lig
     vec3 specular = light.specular * pow(max(dot(normal, halfwayDir), 0.0), shininess)
             * texture(texture_specular1, texCoords).xxx;
 
-    float distance = length(lightPos - fs_in.FragPos);
+    float distance = length(light.position - fs_in.FragPos);
     float attenuation = 1.0 / (light.constant + light.linear * distance + light.quadratic * (distance * distance));
+    // fade out towards the culling radius so the light doesn't end with a visible edge
+    float window = clamp(1.0 - pow(distance / light.radius, 4.0), 0.0, 1.0);
+    attenuation *= window * window;
 
     return (ambient + diffuse + specular) * attenuation;
 }
 
 void main()
 {
-    vec3 viewDir = normalize(fs_in.ViewPos - fs_in.FragPos);
-    vec2 texCoords = ParallaxMapping(fs_in.TexCoords,  viewDir);
+    vec3 viewDir = normalize(viewPos.xyz - fs_in.FragPos);
+    // parallax mapping works with the view direction in tangent space
+    vec2 texCoords = ParallaxMapping(fs_in.TexCoords, normalize(transpose(fs_in.TBN) * viewDir));
 
-    vec3 normal = texture(texture_normal1, texCoords).rgb;
-    normal = normalize(normal * 2.0 - 1.0);
+    // cooked normal maps only store x and y (BC5), so z is always reconstructed
+    vec2 normalXY = texture(texture_normal1, texCoords).rg * 2.0 - 1.0;
+    vec3 normal = vec3(normalXY, sqrt(max(1.0 - dot(normalXY, normalXY), 0.0)));
+    normal = normalize(fs_in.TBN * normal);
 
     vec3 color = vec3(0.0, 0.0, 0.0);
-    for (int i = 0; i < NUM_LIGHTS; i++) {
-        color += BlinnPhong(lights[i], normal, viewDir, texCoords, fs_in.LightPos[i]);
+    uvec2 clusterLights = ClusterLights();
+    for (uint i = 0u; i < clusterLights.y; i++) {
+        int light = int(texelFetch(lightIndices, int(clusterLights.x + i)).r);
+        color += BlinnPhong(lights[light], normal, viewDir, texCoords);
     }
 
     color += texture(texture_emission1, texCoords).rgb;
@@ -2,51 +2,45 @@
 layout (location = 0) in vec3 aPos;
 layout (location = 1) in vec3 aNormal;
 layout (location = 2) in vec2 aTexCoords;
-layout (location = 3) in vec3 aTangent;
-
-#define NUM_LIGHTS 2
+// w is the sign of the bitangent, 1 when the vertex format has no sign
+layout (location = 3) in vec4 aTangent;
+// one per instance, from the render queue
+layout (location = 5) in mat4 model;
 
 out VS_OUT {
     vec3 FragPos;
     vec2 TexCoords;
-    vec3 ViewPos;
-    vec3 LightPos[NUM_LIGHTS];
+    mat3 TBN;
 } vs_out;
 
-struct Light {
-    vec3 position;
-
-    vec3 ambient;
-    vec3 diffuse;
-    vec3 specular;
-
-    float constant;
-    float linear;
-    float quadratic;
+layout (std140) uniform Frame {
+    mat4 view;
+    mat4 projection;
+    vec4 viewPos;
+    int lightCount;
+    // light clusters: tiles per pixel in x and y, scale and bias from log(view depth) to depth slice
+    vec4 clusterScale;
+    ivec4 clusterGrid;
 };
 
-uniform mat4 model;
-uniform mat4 view;
-uniform mat4 projection;
-uniform vec3 viewPos;
-uniform Light lights[NUM_LIGHTS];
+// undoes the quantization of packed vertex positions
+uniform vec3 positionScale;
+uniform vec3 positionOffset;
+
+// matches the depth pre-pass in depth.vs
+invariant gl_Position;
 
 void main()
 {
-    vec3 T = normalize(vec3(model * vec4(aTangent, 0.0)));
+    vec3 T = normalize(vec3(model * vec4(aTangent.xyz, 0.0)));
     vec3 N = normalize(vec3(model * vec4(aNormal, 0.0)));
     T = normalize(T - dot(T, N) * N);
-    vec3 B = cross(N, T);
-
-    mat3 TBN = transpose(mat3(T, B, N));
+    vec3 B = cross(N, T) * (aTangent.w < 0.0 ? -1.0 : 1.0);
 
+    // tangent to world space, lighting is done in world space in the fragment shader
+    vs_out.TBN = mat3(T, B, N);
     vs_out.TexCoords = aTexCoords;
-    vs_out.FragPos = TBN * vec3(model * vec4(aPos, 1.0));
-    vs_out.ViewPos = TBN * viewPos;
-
-    for (int i = 0; i < NUM_LIGHTS; i++) {
-        vs_out.LightPos[i] = TBN * lights[i].position;
-    }
+    vs_out.FragPos = vec3(model * vec4(positionOffset + positionScale * aPos, 1.0));
 
-    gl_Position = projection * view * model * vec4(aPos, 1.0);
-}
\ No newline at end of file
+    gl_Position = projection * view * vec4(vs_out.FragPos, 1.0);
+}
@@ -12,9 +12,27 @@
 #include <learnopengl/shader.h>
 #include <learnopengl/camera.h>
 #include <learnopengl/model_edited.h>
-
+#include <benchmark.h>
+#include <hallway_generator.h>
+#include <light_clusters.h>
+#include <occlusion_culler.h>
+#include <lights.h>
+#include <lod_selector.h>
+#include <profiler.h>
+#include <render_queue.h>
+#include <texture_loader.h>
+#include <thread_pool.h>
+#include <uniform_buffer.h>
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
 #include <iostream>
+#include <numeric>
+#include <optional>
+#include <span>
 #include <stdexcept>
+#include <utility>
 #include <vector>
 
 // executes an action on the exit from scopes
@@ -36,72 +54,48 @@ template <class F>
 
 struct Settings
 {
-    glm::vec3 ambient {0.05f, 0.05f, 0.05f};
-    glm::vec3 diffuse {0.8f, 2.8f, 0.8f};
-    glm::vec3 specular {3.0f, 4.5f, 1.0f};
-    glm::vec3 ambient1 {0.05f, 0.05f, 0.05f};
-    glm::vec3 diffuse1 {1.8f, 0.8f, 0.8f};
-    glm::vec3 specular1 {4.0f, 2.0f, 1.0f};
+    // lights cycle through these colors
+    std::vector<LightColor> light_colors {
+        {{0.05f, 0.05f, 0.05f}, {1.8f, 0.8f, 0.8f}, {4.0f, 2.0f, 1.0f}},
+        {{0.05f, 0.05f, 0.05f}, {0.8f, 2.8f, 0.8f}, {3.0f, 4.5f, 1.0f}},
+    };
     float constant = 1.0f;
     float linear = 0.9f;
     float quadratic = 0.24f;
+    // smallest light contribution that is still shaded, determines the light radius used for culling
+    float light_cutoff = 0.05f;
     float shininess = 32.0f;
     float gamma = 2.2f;
     float exposure = 0.65f;
     float height = 0.01f;
     int min_layers = 4;
     int max_layers = 8;
+    // shade in a lighting pass over a G-buffer instead of while drawing the objects
+    bool deferred_shading = false;
+    // lay down the depth of the opaque objects first so that hidden fragments are never shaded
+    bool depth_pre_pass = false;
     bool bloom = true;
     int blur_amount = 4;
+    // upload model vertices in the compact layout, only read when the models are loaded
+    bool packed_vertices = false;
+    // skip the meshes outside the view
+    bool frustum_culling = true;
+    // skip the meshes hidden behind the walls and the big props
+    bool occlusion_culling = true;
+    // only draw the hallway segments seen through the openings between them
+    bool portal_culling = true;
+    // draw the props with simplified meshes where the difference is too small to see
+    bool level_of_detail = true;
+    // largest simplification error on the screen in pixels
+    float lod_threshold = 1.0f;
+    // skip the parts of the big meshes outside the view or facing away
+    bool meshlet_culling = true;
+    // corridor layout, only read when the hallway is generated
+    int hallway_segments = 1;
+    std::uint32_t hallway_seed = 1;
     float view_angle = 60;
 };
 
-unsigned load_texture(const std::string& filename, bool gamma_correction = false) {
-    unsigned texture{};
-    glGenTextures(1, &texture);
-    glBindTexture(GL_TEXTURE_2D, texture);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-
-    std::cout << "Loading texture " + filename + " ";
-    int width{}, height{}, channels{};
-    unsigned char* data = stbi_load(FileSystem::getPath("resources/textures/" + filename).c_str(), &width, &height, &channels, 3);
-    if (!data) {
-        throw std::runtime_error("Can't find texture " + filename);
-    }
-
-    if (channels == 1) {
-        glTexImage2D(GL_TEXTURE_2D, 0, GL_RED, width, height, 0, GL_RED, GL_UNSIGNED_BYTE, data);
-        std::cout << " asGL_RED" << std::endl;
-    } else  if (channels == 3) {
-        if (gamma_correction) {
-            glTexImage2D(GL_TEXTURE_2D, 0, GL_SRGB, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, data);
-            std::cout << "as GL_SRGB" << std::endl;
-        } else {
-            glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, data);
-            std::cout << "as GL_RGB" << std::endl;
-        }
-    } else if (channels == 4) {
-        if (gamma_correction) {
-            glTexImage2D(GL_TEXTURE_2D, 0, GL_SRGB_ALPHA, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, data);
-            std::cout << "as GL_SRGB_ALPHA" << std::endl;
-        } else {
-            glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, data);
-            std::cout << " as GL_RGBA" << std::endl;
-        }
-    } else {
-        throw std::runtime_error("Texture has " + std::to_string(channels) + " channels");
-    }
-    glGenerateMipmap(GL_TEXTURE_2D);
-
-    stbi_image_free(data);
-    glBindTexture(GL_TEXTURE_2D, 0);
-
-    return texture;
-}
-
 class TextureGroup {
 public:
     explicit TextureGroup(unsigned diffuse, unsigned normal = 0, unsigned specular = 0, unsigned height = 0, unsigned emission = 0)
@@ -112,38 +106,44 @@ public:
     void bind(Shader& shader) const
     {
         glActiveTexture(GL_TEXTURE0);
-        glUniform1i(glGetUniformLocation(shader.ID, "texture_diffuse1"), 0);
+        shader.setInt("texture_diffuse1", 0);
         glBindTexture(GL_TEXTURE_2D, m_diffuse);
         glActiveTexture(GL_TEXTURE1);
-        glUniform1i(glGetUniformLocation(shader.ID, "texture_specular1"), 1);
+        shader.setInt("texture_specular1", 1);
         if (m_specular) {
             glBindTexture(GL_TEXTURE_2D, m_specular);
         } else {
             glBindTexture(GL_TEXTURE_2D, m_diffuse);
         }
         glActiveTexture(GL_TEXTURE2);
-        glUniform1i(glGetUniformLocation(shader.ID, "texture_normal1"), 2);
+        shader.setInt("texture_normal1", 2);
         if (m_normal) {
             glBindTexture(GL_TEXTURE_2D, m_normal);
         } else {
             glBindTexture(GL_TEXTURE_2D, 0);
         }
         glActiveTexture(GL_TEXTURE3);
-        glUniform1i(glGetUniformLocation(shader.ID, "texture_height1"), 3);
+        shader.setInt("texture_height1", 3);
         if (m_height) {
             glBindTexture(GL_TEXTURE_2D, m_height);
         } else {
             glBindTexture(GL_TEXTURE_2D, 0);
         }
         glActiveTexture(GL_TEXTURE4);
-        glUniform1i(glGetUniformLocation(shader.ID, "texture_emission1"), 4);
+        shader.setInt("texture_emission1", 4);
         if (m_emission) {
-            glBindTexture(GL_TEXTURE_2D, m_height);
+            glBindTexture(GL_TEXTURE_2D, m_emission);
         } else {
             glBindTexture(GL_TEXTURE_2D, 0);
         }
     }
 
+    // the textures by unit as bind() binds them
+    [[nodiscard]] Material material() const
+    {
+        return {{m_diffuse, m_specular ? m_specular : m_diffuse, m_normal, m_height, m_emission}};
+    }
+
     static void unbind()
     {
         glActiveTexture(GL_TEXTURE0);
@@ -166,10 +166,11 @@ private:
     unsigned m_emission;
 };
 
+// a quad in the static geometry arena
 class Plane {
 public:
-    Plane(const std::vector<glm::vec3>& vertex_pos, TextureGroup textures, float texture_size = 2.0f)
-        : m_textures{textures}
+    Plane(GeometryArena& arena, const std::vector<glm::vec3>& vertex_pos, TextureGroup textures, float texture_size = 2.0f)
+        : m_textures{textures}, m_arena{&arena}
     {
         init(vertex_pos, texture_size);
     }
@@ -177,26 +178,14 @@ public:
     void draw(Shader& shader) const
     {
         shader.use();
-        bind(shader);
-        glDrawArrays(GL_TRIANGLES, 0, 6);
-        unbind();
+        m_textures.bind(shader);
+        m_arena->draw(m_geometry);
+        TextureGroup::unbind();
     }
 
     Plane(const Plane&) = delete;
     Plane& operator=(const Plane&) = delete;
-
-    ~Plane()
-    {
-        glDeleteVertexArrays(1, &m_VAO);
-        glDeleteBuffers(1, &m_VBO);
-    }
-
-    Plane(Plane&& p) noexcept
-        : m_textures(p.m_textures), m_VAO{p.m_VAO}, m_VBO{p.m_VBO}
-    {
-        p.m_VAO = 0;
-        p.m_VBO = 0;
-    }
+    Plane(Plane&&) noexcept = default;
 
 private:
     void init(const std::vector<glm::vec3>& vertex_pos, float texture_size)
@@ -218,66 +207,72 @@ private:
             tangent.y = f * (deltaUV2.y * edge1.y - deltaUV1.y * edge2.y);
             tangent.z = f * (deltaUV2.y * edge1.z - deltaUV1.y * edge2.z);
         }
+        const glm::vec3 bitangent = glm::cross(normal, tangent);
 
-        constexpr int vertex_size = 3 + 3 + 2 + 3;
-        const float vertices[] {
-                // first triangle
-                vertex_pos[0].x, vertex_pos[0].y, vertex_pos[0].z, normal.x, normal.y, normal.z, tex_pos[0].x, tex_pos[0].y, // bottom left
-                tangent.x, tangent.y, tangent.z,
-                vertex_pos[1].x, vertex_pos[1].y, vertex_pos[1].z, normal.x, normal.y, normal.z, tex_pos[1].x, tex_pos[1].y, // bottom right
-                tangent.x, tangent.y, tangent.z,
-                vertex_pos[2].x, vertex_pos[2].y, vertex_pos[2].z, normal.x, normal.y, normal.z, tex_pos[2].x, tex_pos[2].y, // top right
-                tangent.x, tangent.y, tangent.z,
-                // second triangle
-                vertex_pos[2].x, vertex_pos[2].y, vertex_pos[2].z, normal.x, normal.y, normal.z, tex_pos[2].x, tex_pos[2].y, // top right
-                tangent.x, tangent.y, tangent.z,
-                vertex_pos[3].x, vertex_pos[3].y, vertex_pos[3].z, normal.x, normal.y, normal.z, tex_pos[3].x, tex_pos[3].y, // top left
-                tangent.x, tangent.y, tangent.z,
-                vertex_pos[0].x, vertex_pos[0].y, vertex_pos[0].z, normal.x, normal.y, normal.z, tex_pos[0].x, tex_pos[0].y, // bottom left
-                tangent.x, tangent.y, tangent.z
-        };
-        glGenVertexArrays(1, &m_VAO);
-        glGenBuffers(1, &m_VBO);
-
-        glBindVertexArray(m_VAO);
-        glBindBuffer(GL_ARRAY_BUFFER, m_VBO);
-
-        glBufferData(GL_ARRAY_BUFFER, sizeof(vertices), vertices, GL_STATIC_DRAW);
-
-        // position attribute
-        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, vertex_size * sizeof(float), (void*)nullptr);
-        glEnableVertexAttribArray(0);
-        // normal attribute
-        glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, vertex_size * sizeof(float), (void*)(3 * sizeof(float)));
-        glEnableVertexAttribArray(1);
-        // texture coordinates attribute
-        glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, vertex_size * sizeof(float), (void*)(6 * sizeof(float)));
-        glEnableVertexAttribArray(2);
-        // tangent attribute
-        glVertexAttribPointer(3, 3, GL_FLOAT, GL_FALSE, vertex_size * sizeof(float), (void*)(8 * sizeof(float)));
-        glEnableVertexAttribArray(3);
-
-        glBindVertexArray(0);
-        glBindBuffer(GL_ARRAY_BUFFER, 0);
+        Vertex vertices[4];
+        for (int i = 0; i < 4; i++) {
+            vertices[i] = {vertex_pos[i], normal, tex_pos[i], tangent, bitangent};
+        }
+        // bottom left, bottom right, top right and top right, top left, bottom left
+        const std::uint16_t indices[] {0, 1, 2, 2, 3, 0};
+        m_geometry = m_arena->add(vertexFormat, std::as_bytes(std::span<const Vertex>(vertices)), std::span<const std::uint16_t>(indices));
     }
 
-    void bind(Shader& shader) const
+    TextureGroup m_textures;
+    GeometryArena* m_arena;
+    GeometryArena::Range m_geometry;
+};
+
+// one of the hallway's merged surfaces in the static geometry arena
+class Surface {
+public:
+    Surface(GeometryArena& arena, MeshData&& data, TextureGroup textures)
+        : m_mesh{arena, std::move(data)}, m_textures{textures}
     {
-        m_textures.bind(shader);
-        glBindVertexArray(m_VAO);
-        glBindBuffer(GL_ARRAY_BUFFER, m_VBO);
     }
 
-    static void unbind()
+    void submit(RenderQueue& queue, Shader& shader) const
     {
-        TextureGroup::unbind();
-        glBindVertexArray(0);
-        glBindBuffer(GL_ARRAY_BUFFER, 0);
+        queue.submit(shader, m_textures.material(), m_mesh.geometry, glm::mat4(1.0f), BoundingBox{m_mesh.boundsMin, m_mesh.boundsMax},
+                     m_mesh.positionScale, m_mesh.positionOffset);
     }
 
+private:
+    Mesh m_mesh;
     TextureGroup m_textures;
-    unsigned m_VAO{};
-    unsigned m_VBO{};
+};
+
+// binding points of the uniform blocks shared by the lighting shaders
+constexpr unsigned frame_uniform_binding = 0;
+constexpr unsigned lights_uniform_binding = 1;
+
+// std140 layout of the Frame uniform block
+struct FrameUniforms
+{
+    glm::mat4 view;
+    glm::mat4 projection;
+    glm::vec4 view_pos;
+    int light_count;
+    int padding[3];
+    glm::vec4 cluster_scale;
+    glm::ivec4 cluster_grid;
+};
+
+// uniform locations of the lighting shaders, looked up once so the render loop never queries them by name
+struct LightingUniforms
+{
+    explicit LightingUniforms(const Shader& shader)
+        : shininess{shader.uniformLocation("shininess")},
+          height_scale{shader.uniformLocation("heightScale")},
+          min_layers{shader.uniformLocation("minLayers")},
+          max_layers{shader.uniformLocation("maxLayers")}
+    {
+    }
+
+    GLint shininess;
+    GLint height_scale;
+    GLint min_layers;
+    GLint max_layers;
 };
 
 struct State
@@ -289,36 +284,13 @@ struct State
     int window_width{1280};
     int window_height{720};
     bool is_mouse_initialized{};
+    // smoothed frame time in milliseconds with the depth pre-pass off and on
+    double pre_pass_frame_time[2]{};
+    // hallway segments drawn in the last frame and in the whole hallway
+    std::size_t visible_cells{};
+    std::size_t cell_count{};
 };
 
-std::vector<Plane> generate_hallway(float width, float height, float length, TextureGroup floor_tex, TextureGroup wall_tex, TextureGroup ceiling_tex)
-{
-    constexpr float texture_size = 3.f;
-    const glm::vec3 bottom_left_front{0.f, 0.f, 0.f};
-    const glm::vec3 bottom_right_front{width, 0.f, 0.f};
-    const glm::vec3 top_right_front{width, height, 0.f};
-    const glm::vec3 top_left_front{0.f, height, 0.f};
-    const glm::vec3 bottom_left_back{0.f, 0.f, -length};
-    const glm::vec3 bottom_right_back{width, 0.f, -length};
-    const glm::vec3 top_right_back{width, height, -length};
-    const glm::vec3 top_left_back{0.f, height, -length};
-
-
-    std::vector<Plane> planes;
-    planes.reserve(6);
-    // floor
-    planes.push_back(Plane({bottom_left_front, bottom_right_front, bottom_right_back, bottom_left_back}, floor_tex, texture_size));
-    // walls
-    planes.push_back(Plane({bottom_right_front, bottom_left_front, top_left_front, top_right_front}, wall_tex, texture_size)); // front
-    planes.push_back(Plane({bottom_left_front, bottom_left_back, top_left_back, top_left_front}, wall_tex, texture_size)); // left
-    planes.push_back(Plane({bottom_right_back, bottom_right_front, top_right_front, top_right_back}, wall_tex, texture_size)); // right
-    planes.push_back(Plane({bottom_left_back, bottom_right_back, top_right_back, top_left_back}, wall_tex, texture_size)); // back
-    // ceiling
-    planes.push_back(Plane({top_right_front, top_left_front, top_left_back, top_right_back}, ceiling_tex, texture_size));
-
-    return planes;
-}
-
 class FPS_counter
 {
 public:
@@ -330,12 +302,21 @@ public:
         m_last_frame = current_frame;
         return delta;
     }
+
+    // exponential moving average of a frame time in milliseconds, single frames are too noisy to compare
+    static double smooth_frame_time(double average, double delta)
+    {
+        const double frame_time = delta * 1000.0;
+        return average == 0.0 ? frame_time : average + (frame_time - average) * 0.05;
+    }
+
     double frame_rate{};
 private:
     double m_last_frame{glfwGetTime()};
 };
 
-void draw_gui(Settings& settings, const FPS_counter& fps_counter)
+void draw_gui(Settings& settings, const State& state, const FPS_counter& fps_counter, const Profiler& profiler,
+              const RenderQueue::Statistics& draw_statistics)
 {
     ImGui_ImplOpenGL3_NewFrame();
     ImGui_ImplGlfw_NewFrame();
@@ -348,6 +329,45 @@ void draw_gui(Settings& settings, const FPS_counter& fps_counter)
     ImGui::Text("%s", std::to_string(fps_counter.frame_rate).c_str());
     ImGui::End();
 
+    ImGui::Begin("Profiler");
+    ImGui::SetWindowPos({570, 10}, ImGuiCond_Once);
+    ImGui::SetWindowSize({420, 400}, ImGuiCond_Once);
+    if (ImGui::BeginTable("passes", 3, ImGuiTableFlags_RowBg | ImGuiTableFlags_Borders)) {
+        ImGui::TableSetupColumn("pass");
+        ImGui::TableSetupColumn("GPU ms");
+        ImGui::TableSetupColumn("CPU ms");
+        ImGui::TableHeadersRow();
+        for (const auto& section : profiler.sections()) {
+            if (!profiler.ran_this_frame(section)) {
+                continue;
+            }
+            ImGui::TableNextRow();
+            ImGui::TableNextColumn();
+            ImGui::TextUnformatted(section.name.c_str());
+            ImGui::TableNextColumn();
+            ImGui::Text("%.3f", section.gpu_ms);
+            ImGui::TableNextColumn();
+            ImGui::Text("%.3f", section.cpu_ms);
+        }
+        ImGui::EndTable();
+    }
+    for (const auto& section : profiler.sections()) {
+        if (profiler.ran_this_frame(section)) {
+            ImGui::PlotLines(section.name.c_str(), section.history.data(), static_cast<int>(section.history.size()),
+                             static_cast<int>(section.history_offset), nullptr, 0.0f, FLT_MAX, {0, 40});
+        }
+    }
+    ImGui::Text("draws: %zu (%zu instances)", draw_statistics.draws, draw_statistics.instances);
+    ImGui::Text("meshes visible: %zu, culled: %zu, occluded: %zu", draw_statistics.instances, draw_statistics.culled, draw_statistics.occluded);
+    ImGui::Text("hallway segments visible: %zu / %zu", state.visible_cells, state.cell_count);
+    ImGui::Text("meshlets visible: %zu / %zu", draw_statistics.meshlets - draw_statistics.meshlets_culled, draw_statistics.meshlets);
+    ImGui::Text("triangles by level of detail: %zu / %zu / %zu / %zu", draw_statistics.lod_triangles[0], draw_statistics.lod_triangles[1],
+                draw_statistics.lod_triangles[2], draw_statistics.lod_triangles[3]);
+    ImGui::Text("program changes: %zu (%zu unsorted)", draw_statistics.program_changes, draw_statistics.unsorted_program_changes);
+    ImGui::Text("texture binds: %zu (%zu unsorted)", draw_statistics.texture_binds, draw_statistics.unsorted_texture_binds);
+    ImGui::Text("vertex array binds: %zu (%zu unsorted)", draw_statistics.vertex_array_binds, draw_statistics.unsorted_vertex_array_binds);
+    ImGui::End();
+
     ImGui::Begin("Settings");
     ImGui::SetWindowPos({10, 70}, ImGuiCond_Once);
     ImGui::SetWindowSize({550, 550}, ImGuiCond_Once);
@@ -355,21 +375,39 @@ void draw_gui(Settings& settings, const FPS_counter& fps_counter)
     ImGui::DragFloat("gamma", &settings.gamma, 0.005, 0.0f, 4.0f);
     ImGui::DragFloat("exposure", &settings.exposure, 0.005, 0.0f, 4.0f);
     ImGui::DragFloat("view_angle", &settings.view_angle, 0.1, 20.0f, 90.0f);
-    ImGui::ColorEdit3("ambient", reinterpret_cast<float *>(&settings.ambient));
-    ImGui::ColorEdit3("diffuse", reinterpret_cast<float *>(&settings.diffuse));
-    ImGui::ColorEdit3("specular", reinterpret_cast<float *>(&settings.specular));
-    ImGui::ColorEdit3("ambient1", reinterpret_cast<float *>(&settings.ambient1));
-    ImGui::ColorEdit3("diffuse1", reinterpret_cast<float *>(&settings.diffuse1));
-    ImGui::ColorEdit3("specular1", reinterpret_cast<float *>(&settings.specular1));
+    for (std::size_t i = 0; i < settings.light_colors.size(); i++) {
+        auto& color = settings.light_colors[i];
+        ImGui::PushID(static_cast<int>(i));
+        ImGui::Text("light color %zu", i);
+        ImGui::ColorEdit3("ambient", reinterpret_cast<float *>(&color.ambient));
+        ImGui::ColorEdit3("diffuse", reinterpret_cast<float *>(&color.diffuse));
+        ImGui::ColorEdit3("specular", reinterpret_cast<float *>(&color.specular));
+        ImGui::PopID();
+    }
     ImGui::DragFloat("attenuation.constant", &settings.constant, 0.005, 0.0, 2.0);
     ImGui::DragFloat("attenuation.linear", &settings.linear, 0.005, 0.0, 2.0);
     ImGui::DragFloat("attenuation.quadratic", &settings.quadratic, 0.005, 0.0, 2.0);
+    ImGui::DragFloat("light cutoff", &settings.light_cutoff, 0.0005, 0.001, 1.0);
     ImGui::DragFloat("shininess", &settings.shininess, 0.25, 0.0, 1000.0);
     ImGui::DragFloat("height", &settings.height, 0.00005, 0.00f, 0.5f);
     ImGui::DragInt("min_layers", &settings.min_layers, 0.1, 1, 512);
     ImGui::DragInt("max_layers", &settings.max_layers, 0.1, 1, 512);
+    ImGui::Checkbox("deferred shading", &settings.deferred_shading);
+    ImGui::Checkbox("depth pre-pass", &settings.depth_pre_pass);
+    ImGui::Text("frame time: %.2f ms without pre-pass, %.2f ms with pre-pass (%+.2f ms)",
+                state.pre_pass_frame_time[0], state.pre_pass_frame_time[1],
+                state.pre_pass_frame_time[1] - state.pre_pass_frame_time[0]);
     ImGui::Checkbox("bloom", &settings.bloom);
+    ImGui::Checkbox("frustum culling", &settings.frustum_culling);
+    ImGui::Checkbox("occlusion culling", &settings.occlusion_culling);
+    ImGui::Checkbox("portal culling", &settings.portal_culling);
+    ImGui::Checkbox("level of detail", &settings.level_of_detail);
+    ImGui::DragFloat("level of detail error (pixels)", &settings.lod_threshold, 0.05, 0.1, 20.0);
+    ImGui::Checkbox("meshlet culling", &settings.meshlet_culling);
     ImGui::DragInt("bloom blur amount", &settings.blur_amount, 0.2, 0, 50);
+    const auto& textures = TextureRegistry::instance().statistics();
+    ImGui::Text("textures: %zu, %.1f MB resident, cache hits %zu / misses %zu",
+                textures.textures, static_cast<double>(textures.resident_bytes) / (1024.0 * 1024.0), textures.hits, textures.misses);
     ImGui::Text("Keybindings:");
     ImGui::BulletText("Q or F1 - open/close settings and help");
     ImGui::BulletText("W A S D - move");
@@ -383,31 +421,63 @@ void draw_gui(Settings& settings, const FPS_counter& fps_counter)
 class Framebuffer
 {
 public:
+    enum class Depth
+    {
+        none,
+        renderbuffer,
+        texture // depth can be sampled in shaders
+    };
+
     Framebuffer(int width, int height, bool create_depth_buffer = true)
-        : m_width(width), m_height(height)
+        : Framebuffer(width, height, {GL_RGBA16F}, create_depth_buffer ? Depth::renderbuffer : Depth::none)
+    {
+    }
+
+    // framebuffer with a color attachment for every format, all of them are drawn to
+    Framebuffer(int width, int height, const std::vector<GLenum>& color_formats, Depth depth)
+        : m_width(width), m_height(height), m_color_formats(color_formats), m_color_buffers(color_formats.size()), m_depth(depth)
     {
         glGenFramebuffers(1, &m_framebuffer);
 
-        glGenTextures(1, &m_color_buffer);
-        glBindTexture(GL_TEXTURE_2D, m_color_buffer);
-        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA16F, width, height, 0, GL_RGBA, GL_FLOAT, nullptr);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        glGenTextures(static_cast<GLsizei>(m_color_buffers.size()), m_color_buffers.data());
+        for (std::size_t i = 0; i < m_color_buffers.size(); i++) {
+            glBindTexture(GL_TEXTURE_2D, m_color_buffers[i]);
+            glTexImage2D(GL_TEXTURE_2D, 0, static_cast<GLint>(m_color_formats[i]), width, height, 0, GL_RGBA, GL_FLOAT, nullptr);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        }
         glBindTexture(GL_TEXTURE_2D, 0);
 
-        if (create_depth_buffer) {
+        if (m_depth == Depth::renderbuffer) {
             glGenRenderbuffers(1, &m_depth_buffer);
             glBindRenderbuffer(GL_RENDERBUFFER, m_depth_buffer);
-            glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT, width, height);
+            glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, width, height);
             glBindRenderbuffer(GL_RENDERBUFFER, 0);
+        } else if (m_depth == Depth::texture) {
+            glGenTextures(1, &m_depth_buffer);
+            glBindTexture(GL_TEXTURE_2D, m_depth_buffer);
+            glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT24, width, height, 0, GL_DEPTH_COMPONENT, GL_FLOAT, nullptr);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+            glBindTexture(GL_TEXTURE_2D, 0);
         }
 
         glBindFramebuffer(GL_FRAMEBUFFER, m_framebuffer);
-        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, m_color_buffer, 0);
-        if (create_depth_buffer) {
+        std::vector<GLenum> draw_buffers;
+        for (std::size_t i = 0; i < m_color_buffers.size(); i++) {
+            const auto attachment = static_cast<GLenum>(GL_COLOR_ATTACHMENT0 + i);
+            glFramebufferTexture2D(GL_FRAMEBUFFER, attachment, GL_TEXTURE_2D, m_color_buffers[i], 0);
+            draw_buffers.push_back(attachment);
+        }
+        glDrawBuffers(static_cast<GLsizei>(draw_buffers.size()), draw_buffers.data());
+        if (m_depth == Depth::renderbuffer) {
             glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, m_depth_buffer);
+        } else if (m_depth == Depth::texture) {
+            glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, m_depth_buffer, 0);
         }
         if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
             std::cerr << "Error: Framebuffer not complete!" << std::endl;
@@ -420,9 +490,11 @@ public:
 
     ~Framebuffer()
     {
-        glDeleteTextures(1, &m_color_buffer);
-        if (m_depth_buffer)
+        glDeleteTextures(static_cast<GLsizei>(m_color_buffers.size()), m_color_buffers.data());
+        if (m_depth == Depth::renderbuffer)
             glDeleteRenderbuffers(1, &m_depth_buffer);
+        else if (m_depth == Depth::texture)
+            glDeleteTextures(1, &m_depth_buffer);
         glDeleteFramebuffers(1, &m_framebuffer);
     }
 
@@ -436,9 +508,24 @@ public:
         glBindFramebuffer(GL_FRAMEBUFFER, 0);
     }
 
-    unsigned int color_buffer() // NOLINT(*-make-member-function-const): Can be used to change color buffer
+    unsigned int color_buffer(std::size_t index = 0) // NOLINT(*-make-member-function-const): Can be used to change color buffer
+    {
+        return m_color_buffers[index];
+    }
+
+    // depth texture, only for framebuffers created with Depth::texture
+    unsigned int depth_texture() // NOLINT(*-make-member-function-const): Can be used to change depth buffer
+    {
+        return m_depth == Depth::texture ? m_depth_buffer : 0;
+    }
+
+    // copies the depth buffer into the target framebuffer, which must have the same size
+    void blit_depth(Framebuffer& target) // NOLINT(*-make-member-function-const): Binds the framebuffer
     {
-        return m_color_buffer;
+        glBindFramebuffer(GL_READ_FRAMEBUFFER, m_framebuffer);
+        glBindFramebuffer(GL_DRAW_FRAMEBUFFER, target.m_framebuffer);
+        glBlitFramebuffer(0, 0, m_width, m_height, 0, 0, target.m_width, target.m_height, GL_DEPTH_BUFFER_BIT, GL_NEAREST);
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
     }
 
     void update_size(int width, int height)
@@ -453,32 +540,71 @@ public:
 private:
     void resize(int width, int height) // NOLINT(*-make-member-function-const): Changes framebuffer
     {
-        glBindTexture(GL_TEXTURE_2D, m_color_buffer);
-        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA16F, width, height, 0, GL_RGBA, GL_FLOAT, nullptr);
+        for (std::size_t i = 0; i < m_color_buffers.size(); i++) {
+            glBindTexture(GL_TEXTURE_2D, m_color_buffers[i]);
+            glTexImage2D(GL_TEXTURE_2D, 0, static_cast<GLint>(m_color_formats[i]), width, height, 0, GL_RGBA, GL_FLOAT, nullptr);
+        }
         glBindTexture(GL_TEXTURE_2D, 0);
-        if (m_depth_buffer) {
+        if (m_depth == Depth::renderbuffer) {
             glBindRenderbuffer(GL_RENDERBUFFER, m_depth_buffer);
-            glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT, width, height);
+            glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, width, height);
             glBindRenderbuffer(GL_RENDERBUFFER, 0);
+        } else if (m_depth == Depth::texture) {
+            glBindTexture(GL_TEXTURE_2D, m_depth_buffer);
+            glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT24, width, height, 0, GL_DEPTH_COMPONENT, GL_FLOAT, nullptr);
+            glBindTexture(GL_TEXTURE_2D, 0);
         }
     }
 
     int m_width{};
     int m_height{};
+    std::vector<GLenum> m_color_formats;
+    std::vector<unsigned int> m_color_buffers;
+    Depth m_depth{};
     unsigned int m_framebuffer{};
-    unsigned int m_color_buffer{};
     unsigned int m_depth_buffer{};
 };
 
+enum class SceneObjects
+{
+    opaque,
+    transparent
+};
+
 void process_input(GLFWwindow *window, State& state, float delta_time);
 void cursor_pos_callback(GLFWwindow *window, double xpos, double ypos);
 void key_callback(GLFWwindow *window, int key, int scancode, int action, int mods);
 void framebuffer_size_callback(GLFWwindow* window, int width, int height);
 
-int main() {
+int main(int argc, char** argv) {
     Settings settings;
     State state;
 
+    std::optional<BenchmarkOptions> benchmark;
+    try {
+        benchmark = parse_benchmark_options(argc, argv);
+    } catch (const std::exception& e) {
+        std::cerr << e.what() << std::endl;
+        std::cerr << "Usage: " << argv[0] << " [--bench [--frames N] [--warmup N] [--width W] [--height H] "
+                  << "[--output FILE.json|FILE.csv] [--deferred] [--depth-pre-pass] [--no-bloom] [--packed-vertices] "
+                  << "[--segments N] [--seed N] [--no-occlusion-culling] [--no-portal-culling] [--no-lod] [--no-meshlet-culling]]" << std::endl;
+        return -1;
+    }
+    if (benchmark) {
+        state.window_width = benchmark->width;
+        state.window_height = benchmark->height;
+        settings.deferred_shading = benchmark->deferred_shading;
+        settings.depth_pre_pass = benchmark->depth_pre_pass;
+        settings.bloom = benchmark->bloom;
+        settings.packed_vertices = benchmark->packed_vertices;
+        settings.hallway_segments = benchmark->hallway_segments;
+        settings.hallway_seed = benchmark->hallway_seed;
+        settings.occlusion_culling = benchmark->occlusion_culling;
+        settings.portal_culling = benchmark->portal_culling;
+        settings.level_of_detail = benchmark->level_of_detail;
+        settings.meshlet_culling = benchmark->meshlet_culling;
+    }
+
     // glfw: initialize and configure
     // ------------------------------
     glfwInit();
@@ -486,6 +612,11 @@ int main() {
     glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
     glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
     glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+    if (benchmark) {
+        // rendered offscreen at a fixed size, the window is never shown or resized
+        glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+        glfwWindowHint(GLFW_RESIZABLE, GLFW_FALSE);
+    }
 
     // glfw window creation
     // --------------------
@@ -495,6 +626,10 @@ int main() {
         return -1;
     }
     glfwMakeContextCurrent(window);
+    if (benchmark) {
+        // measure the renderer, not the display's refresh rate
+        glfwSwapInterval(0);
+    }
     glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_DISABLED);
     if (glfwRawMouseMotionSupported())
         glfwSetInputMode(window, GLFW_RAW_MOUSE_MOTION, GLFW_TRUE);
@@ -512,9 +647,6 @@ int main() {
     }
 
 
-    // tell stb_image.h to flip loaded texture's on the y-axis (before loading model).
-    stbi_set_flip_vertically_on_load(true);
-
     // Init Imgui
     IMGUI_CHECKVERSION();
     ImGui::CreateContext();
@@ -545,6 +677,13 @@ int main() {
     Shader shader("resources/shaders/shader.vs", "resources/shaders/shader.fs");
     std::cout << "Compiling no normal mapping shader" << std::endl;
     Shader no_normal_shader("resources/shaders/shader.vs", "resources/shaders/no_normal_mapping.fs");
+    std::cout << "Compiling depth pre-pass shader" << std::endl;
+    Shader depth_shader("resources/shaders/depth.vs", "resources/shaders/depth.fs");
+    std::cout << "Compiling G-buffer shaders" << std::endl;
+    Shader gbuffer_shader("resources/shaders/shader.vs", "resources/shaders/gbuffer.fs");
+    Shader gbuffer_no_normal_shader("resources/shaders/shader.vs", "resources/shaders/gbuffer_no_normal_mapping.fs");
+    std::cout << "Compiling deferred lighting shader" << std::endl;
+    Shader deferred_shader("resources/shaders/screen.vs", "resources/shaders/deferred_lighting.fs");
     std::cout << "Compiling bright fragment extraction shader" << std::endl;
     Shader bright_shader("resources/shaders/screen.vs", "resources/shaders/bright.fs");
     std::cout << "Compiling blur shaders" << std::endl;
@@ -553,31 +692,60 @@ int main() {
     std::cout << "Compiling tone mapping shader" << std::endl;
     Shader screen_shader("resources/shaders/screen.vs", "resources/shaders/screen.fs");
 
+    for (Shader* lighting_shader : {&shader, &no_normal_shader, &gbuffer_shader, &gbuffer_no_normal_shader, &deferred_shader, &depth_shader}) {
+        lighting_shader->bindUniformBlock("Frame", frame_uniform_binding);
+        lighting_shader->bindUniformBlock("Lights", lights_uniform_binding);
+        lighting_shader->use();
+        lighting_shader->setInt("lightGrid", LightClusters::grid_texture_unit);
+        lighting_shader->setInt("lightIndices", LightClusters::indices_texture_unit);
+    }
+    const LightingUniforms shader_uniforms{shader};
+    const LightingUniforms no_normal_uniforms{no_normal_shader};
+    const LightingUniforms gbuffer_uniforms{gbuffer_shader};
+    const GLint deferred_shininess_uniform = deferred_shader.uniformLocation("shininess");
+    const GLint deferred_inverse_view_projection_uniform = deferred_shader.uniformLocation("inverseViewProjection");
+    UniformBuffer frame_uniforms{sizeof(FrameUniforms), frame_uniform_binding};
+    UniformBuffer lights_uniforms{max_lights * sizeof(Light), lights_uniform_binding};
+    const GLint screen_gamma_uniform = screen_shader.uniformLocation("gamma");
+    const GLint screen_exposure_uniform = screen_shader.uniformLocation("exposure");
+
     // load models
     // -----------
     std::cout << "\nLoading models..." << std::endl;
 
-    stbi_set_flip_vertically_on_load(false);
+    // every image is decoded on the pool while the rest of the assets load, and uploaded at the end
+    ThreadPool thread_pool;
+    TextureLoader texture_loader{thread_pool};
+    // every model and plane is drawn from the same few buffers
+    GeometryArena geometry_arena;
+    const VertexLayout vertex_layout = settings.packed_vertices ? VertexLayout::packed : VertexLayout::full;
 
     std::cout << "Loading lamp model" << std::endl;
-    Model light_model(FileSystem::getPath("resources/objects/lamp/lamp.obj"), true);
+    Model light_model(FileSystem::getPath("resources/objects/lamp/lamp.obj"), texture_loader, geometry_arena, true, vertex_layout);
     std::cout << "Loading arcade model" << std::endl;
-    Model arcade_model(FileSystem::getPath("resources/objects/rusty_japanese_arcade/rusty_japanese_arcade.obj"), true);
+    Model arcade_model(FileSystem::getPath("resources/objects/rusty_japanese_arcade/rusty_japanese_arcade.obj"), texture_loader, geometry_arena, true, vertex_layout);
     std::cout << "Loading trash model" << std::endl;
-    Model trash_model(FileSystem::getPath("resources/objects/trash/trash.obj"), true);
+    Model trash_model(FileSystem::getPath("resources/objects/trash/trash.obj"), texture_loader, geometry_arena, true, vertex_layout);
     std::cout << "Loading door model" << std::endl;
-    Model door_model(FileSystem::getPath("resources/objects/door/door.obj"), true);
+    Model door_model(FileSystem::getPath("resources/objects/door/door.obj"), texture_loader, geometry_arena, true, vertex_layout);
     std::cout << "Loading vending machine model" << std::endl;
-    Model vending_model(FileSystem::getPath("resources/objects/ramen_vending_machine/vending.obj"), true);
+    Model vending_model(FileSystem::getPath("resources/objects/ramen_vending_machine/vending.obj"), texture_loader, geometry_arena, true, vertex_layout);
     std::cout << "Loading poster model" << std::endl;
-    Model poster_model(FileSystem::getPath("resources/objects/poster/poster.obj"), true);
+    Model poster_model(FileSystem::getPath("resources/objects/poster/poster.obj"), texture_loader, geometry_arena, true, vertex_layout);
     std::cout << "Loading bottle model" << std::endl;
-    Model bottle_model(FileSystem::getPath("resources/objects/broken_glass_bottle/bottle.obj"), false);
-
-    stbi_set_flip_vertically_on_load(true);
+    Model bottle_model(FileSystem::getPath("resources/objects/broken_glass_bottle/bottle.obj"), texture_loader, geometry_arena, false, vertex_layout);
+    // in the order of Prop
+    const std::array<const Model*, prop_count> prop_models{&door_model, &vending_model, &arcade_model, &light_model, &trash_model,
+                                                           &poster_model, &bottle_model};
 
     std::cout << "\nLoading textures..." << std::endl;
 
+    // the hallway textures are flipped to match the planes' texture coordinates
+    const auto load_texture = [&](const std::string& filename, bool gamma_correction = false) {
+        return texture_loader.load(FileSystem::getPath("resources/textures/" + filename),
+                                   {gamma_correction, true, 3, true});
+    };
+
     const auto floor_diffuse_texture = load_texture("Checker_Tiles/Checker_Tiles_DIFF.png", true);
     const auto floor_normal_texture = load_texture("Checker_Tiles/Checker_Tiles_NRM.png");
     const auto floor_specular_texture = load_texture("Checker_Tiles/Checker_Tiles_SPEC.png");
@@ -588,32 +756,71 @@ int main() {
     const auto wall_specular_texture = load_texture("Dirty_Concrete/Dirty_Concrete_SPEC.png");
     const auto wall_height_texture = load_texture("Dirty_Concrete/Dirty_Concrete_DISP.png");
 
-    auto delete_textures = finally([&]{
-        glDeleteTextures(1, &floor_diffuse_texture);
-        glDeleteTextures(1, &floor_normal_texture);
-        glDeleteTextures(1, &floor_specular_texture);
-        glDeleteTextures(1, &floor_height_texture);
+    texture_loader.finish();
+
+    TextureGroup floor {floor_diffuse_texture.id(), floor_normal_texture.id(), floor_specular_texture.id(), floor_height_texture.id()};
+    TextureGroup wall {wall_diffuse_texture.id(), wall_normal_texture.id(), wall_specular_texture.id(), wall_height_texture.id()};
+    HallwayOptions hallway_options;
+    hallway_options.segments = settings.hallway_segments;
+    hallway_options.seed = settings.hallway_seed;
+    Hallway hallway = generate_hallway(hallway_options);
+    const float hallway_width = hallway.width;
+    const float hallway_length = hallway.length;
+    std::vector<Surface> surfaces;
+    surfaces.reserve(3 * hallway.chunks.size());
+    // the walls hide everything behind them, the floor and the ceiling nothing as long as the camera is inside
+    std::vector<OccluderMesh> wall_occluders;
+    wall_occluders.reserve(hallway.chunks.size());
+    for (HallwayChunk& chunk : hallway.chunks) {
+        wall_occluders.push_back(OccluderMesh::from_mesh(chunk.walls));
+        surfaces.emplace_back(geometry_arena, std::move(chunk.floor), floor);
+        surfaces.emplace_back(geometry_arena, std::move(chunk.walls), wall);
+        surfaces.emplace_back(geometry_arena, std::move(chunk.ceiling), wall);
+    }
+    std::size_t prop_instances = 0;
+    for (const auto& instances : hallway.props) {
+        prop_instances += instances.size();
+    }
+    std::cout << "Generated a hallway of " << hallway_options.segments << " segments with " << prop_instances << " props and "
+              << hallway.light_positions.size() << " lights" << std::endl;
+    if (hallway.light_positions.size() > max_lights) {
+        std::cout << "Only the " << max_lights << " lights nearest to the camera are shaded" << std::endl;
+    }
 
-        glDeleteTextures(1, &wall_diffuse_texture);
-        glDeleteTextures(1, &wall_normal_texture);
-        glDeleteTextures(1, &wall_specular_texture);
-        glDeleteTextures(1, &wall_height_texture);
-    });
+    // the big props are about as solid as their bounds, shrinking them keeps the proxies inside the meshes
+    constexpr float occluder_shrink = 0.75f;
+    const std::array<std::pair<Prop, OccluderMesh>, 3> prop_occluders {{
+        {Prop::door, OccluderMesh::box({door_model.boundsMin, door_model.boundsMax}, occluder_shrink)},
+        {Prop::vending_machine, OccluderMesh::box({vending_model.boundsMin, vending_model.boundsMax}, occluder_shrink)},
+        {Prop::arcade, OccluderMesh::box({arcade_model.boundsMin, arcade_model.boundsMax}, occluder_shrink)},
+    }};
+    OcclusionCuller occlusion_culler{thread_pool};
+
+    // the level of detail of every prop instance in the last frame, for the selection's hysteresis
+    LodSelector lod_selector;
+    std::array<std::vector<std::uint8_t>, prop_count> prop_lods;
+    for (std::size_t prop = 0; prop < prop_count; prop++) {
+        prop_lods[prop].resize(hallway.props[prop].size());
+    }
 
-    TextureGroup floor {floor_diffuse_texture, floor_normal_texture, floor_specular_texture, floor_height_texture};
-    TextureGroup wall {wall_diffuse_texture, wall_normal_texture, wall_specular_texture, wall_height_texture};
-    const float hallway_width = 5.f;
-    const float hallway_height = 4.f;
-    const float hallway_length = 10.f;
-    std::vector<Plane> planes = generate_hallway(hallway_width, hallway_height, hallway_length, floor, wall, wall);
+    const std::vector<glm::vec3>& light_positions = hallway.light_positions;
+    // indices into light_positions, the shaded ones first
+    std::vector<std::size_t> light_order(light_positions.size());
+    std::iota(light_order.begin(), light_order.end(), std::size_t{0});
+    std::vector<Light> lights(std::min(light_positions.size(), max_lights));
+    LightClusters light_clusters;
 
+    // G-buffer: albedo with specular intensity in alpha, world space normal, emission and depth
+    Framebuffer g_buffer{state.window_width, state.window_height, {GL_RGBA16F, GL_RGBA16F, GL_RGBA16F}, Framebuffer::Depth::texture};
     Framebuffer hdr_buffer{state.window_width, state.window_height};
     Framebuffer bright_buffer{state.window_width, state.window_height, false};
     Framebuffer blur_buffer{state.window_width, state.window_height, false};
 
-    Plane screen_plane({{-1.f, -1.f, 0.f}, {1.f, -1.f, 0.f}, {1.f, 1.f, 0.f}, {-1.f, 1.f, 0.f}}, TextureGroup{hdr_buffer.color_buffer()});
-    Plane bright_plane({{-1.f, -1.f, 0.f}, {1.f, -1.f, 0.f}, {1.f, 1.f, 0.f}, {-1.f, 1.f, 0.f}}, TextureGroup{bright_buffer.color_buffer(), 0, hdr_buffer.color_buffer()});
-    Plane blur_plane({{-1.f, -1.f, 0.f}, {1.f, -1.f, 0.f}, {1.f, 1.f, 0.f}, {-1.f, 1.f, 0.f}}, TextureGroup{blur_buffer.color_buffer()});
+    Plane screen_plane(geometry_arena, {{-1.f, -1.f, 0.f}, {1.f, -1.f, 0.f}, {1.f, 1.f, 0.f}, {-1.f, 1.f, 0.f}}, TextureGroup{hdr_buffer.color_buffer()});
+    Plane bright_plane(geometry_arena, {{-1.f, -1.f, 0.f}, {1.f, -1.f, 0.f}, {1.f, 1.f, 0.f}, {-1.f, 1.f, 0.f}}, TextureGroup{bright_buffer.color_buffer(), 0, hdr_buffer.color_buffer()});
+    Plane lighting_plane(geometry_arena, {{-1.f, -1.f, 0.f}, {1.f, -1.f, 0.f}, {1.f, 1.f, 0.f}, {-1.f, 1.f, 0.f}},
+                         TextureGroup{g_buffer.color_buffer(0), g_buffer.color_buffer(1), 0, g_buffer.depth_texture(), g_buffer.color_buffer(2)});
+    Plane blur_plane(geometry_arena, {{-1.f, -1.f, 0.f}, {1.f, -1.f, 0.f}, {1.f, 1.f, 0.f}, {-1.f, 1.f, 0.f}}, TextureGroup{blur_buffer.color_buffer()});
 
     // draw in wireframe
 //    glPolygonMode(GL_FRONT_AND_BACK, GL_LINE);
@@ -621,6 +828,88 @@ int main() {
     std::cout << "\nLoading done\n" << std::endl;
 
     constexpr glm::vec3 clear_color{0.0f, 0.0f, 0.0f};
+    constexpr float z_near = 0.1f;
+    constexpr float z_far = 100.0f;
+
+    RenderQueue render_queue{geometry_arena};
+    // the frame's view frustum, the hallway segments seen from the camera and the chunks of surfaces they are in
+    Frustum view_frustum;
+    std::span<const PortalGraph::VisibleCell> visible_cells;
+    std::vector<bool> visible_chunks(hallway.chunks.size());
+
+    // submits the segment's instances of the prop at their level of detail, culled against the frustum the
+    // segment is seen through
+    const auto submit_props = [&](Prop prop, Shader& shader, const PortalGraph::VisibleCell& cell) {
+        render_queue.set_frustum(settings.frustum_culling ? cell.frustum : Frustum{});
+        const auto index = static_cast<std::size_t>(prop);
+        const std::size_t first = hallway.segment_props[cell.cell][index];
+        const auto instances = hallway.instances(prop, cell.cell);
+        for (std::size_t i = 0; i < instances.size(); i++) {
+            render_queue.submit(shader, *prop_models[index], instances[i], settings.level_of_detail ? prop_lods[index][first + i] : 0);
+        }
+    };
+    // draws the visible part of the hallway and the objects in it, normal mapped ones with lit_shader and the
+    // rest with flat_shader. Opaque objects are sorted by state and drawn front to back, transparent ones back
+    // to front.
+    const auto draw_scene = [&](Shader& lit_shader, Shader& flat_shader, SceneObjects objects) {
+        render_queue.clear();
+        if (objects == SceneObjects::opaque) {
+            render_queue.set_frustum(view_frustum);
+            for (std::size_t chunk = 0; chunk < visible_chunks.size(); chunk++) {
+                if (visible_chunks[chunk]) {
+                    for (std::size_t i = 3 * chunk; i < 3 * chunk + 3; i++) {
+                        surfaces[i].submit(render_queue, lit_shader);
+                    }
+                }
+            }
+            for (const auto& cell : visible_cells) {
+                submit_props(Prop::arcade, lit_shader, cell);
+                submit_props(Prop::trash, lit_shader, cell);
+                submit_props(Prop::door, flat_shader, cell);
+                submit_props(Prop::vending_machine, lit_shader, cell);
+                submit_props(Prop::poster, lit_shader, cell);
+                submit_props(Prop::lamp, lit_shader, cell);
+            }
+            render_queue.sort(state.camera.Position, RenderQueue::Order::state_then_front_to_back);
+        }
+
+        if (objects == SceneObjects::transparent) {
+            for (const auto& cell : visible_cells) {
+                submit_props(Prop::bottle, lit_shader, cell);
+            }
+            render_queue.sort(state.camera.Position, RenderQueue::Order::back_to_front);
+        }
+        render_queue.execute();
+        TextureGroup::unbind();
+    };
+
+    // fills the depth buffer with the opaque objects and sets up the depth test so that
+    // the following color pass only shades the fragments that are visible
+    const auto begin_depth_pre_pass = [&]() {
+        glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+        draw_scene(depth_shader, depth_shader, SceneObjects::opaque);
+        glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+        glDepthFunc(GL_LEQUAL);
+        glDepthMask(GL_FALSE);
+    };
+    // restores depth writes, needed before the depth buffer is cleared or blitted again
+    const auto end_depth_pre_pass = []() {
+        glDepthFunc(GL_LESS);
+        glDepthMask(GL_TRUE);
+    };
+
+    // benchmark camera: a loop down the left side of the hallway and back along the right
+    const CameraPath benchmark_path({
+        {hallway_width / 2.f, 1.6f, -0.5f},
+        {1.2f, 1.5f, -hallway_length / 3.f},
+        {1.5f, 1.7f, -2.f * hallway_length / 3.f},
+        {hallway_width / 2.f, 1.4f, -hallway_length + 1.f},
+        {hallway_width - 1.2f, 1.6f, -2.f * hallway_length / 3.f},
+        {hallway_width - 1.5f, 1.5f, -hallway_length / 3.f},
+    });
+    Profiler profiler;
+    BenchmarkRecorder recorder{benchmark.has_value()};
+    int frame = 0;
 
     FPS_counter fps_counter;
 
@@ -630,185 +919,194 @@ int main() {
         // per-frame time logic
         // --------------------
         const double delta_time = fps_counter.next_frame();
+        auto& frame_time = state.pre_pass_frame_time[settings.depth_pre_pass ? 1 : 0];
+        frame_time = FPS_counter::smooth_frame_time(frame_time, delta_time);
 
         // input
         // -----
-        process_input(window, state, static_cast<float>(delta_time));
+        if (benchmark) {
+            // the camera follows the path by frame number, so every run renders the same images
+            if (frame == benchmark->warmup_frames + benchmark->frames) {
+                break;
+            }
+            if (frame == benchmark->warmup_frames) {
+                recorder.clear();
+            }
+            const float t = static_cast<float>(std::max(frame - benchmark->warmup_frames, 0)) / static_cast<float>(benchmark->frames);
+            state.camera = Camera{benchmark_path.position(t), glm::vec3{0.f, 1.f, 0.f}, benchmark_path.yaw(t), benchmark_path.pitch(t)};
+            frame++;
+        } else {
+            process_input(window, state, static_cast<float>(delta_time));
+        }
+        profiler.begin_frame();
+        render_queue.begin_frame();
+        recorder.begin_frame();
+        g_buffer.update_size(state.window_width, state.window_height);
         hdr_buffer.update_size(state.window_width, state.window_height);
         bright_buffer.update_size(state.window_width, state.window_height);
         blur_buffer.update_size(state.window_width, state.window_height);
 
 
-        // render to framebuffer
-        // ---------------------
-        hdr_buffer.bind();
-        glClearColor(clear_color.r, clear_color.g, clear_color.b, 1.0f);
-        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-
+        // per-frame uniforms
+        // ------------------
         const auto projection = glm::perspective(glm::radians(settings.view_angle),
                                                  static_cast<float>(state.window_width) / static_cast<float>(state.window_height),
-                                                 0.1f, 100.0f);
+                                                 z_near, z_far);
 
         const auto view = state.camera.GetViewMatrix();
-
-        shader.use();
-        shader.setMat4("model", glm::mat4(1.0f));
-        shader.setMat4("view", view);
-        shader.setMat4("projection", projection);
-        // point light 1
-        shader.setVec3("lights[0].position", glm::vec3{hallway_width - 0.5f, hallway_height - 0.5f, -3.f * hallway_length / 4.f});
-        shader.setVec3("lights[0].ambient", settings.ambient1.r, settings.ambient1.g, settings.ambient1.b);
-        shader.setVec3("lights[0].diffuse", settings.diffuse1.r, settings.diffuse1.g, settings.diffuse1.b);
-        shader.setVec3("lights[0].specular", settings.specular1.r, settings.specular1.g, settings.specular1.b);
-        shader.setFloat("lights[0].constant", settings.constant);
-        shader.setFloat("lights[0].linear", settings.linear);
-        shader.setFloat("lights[0].quadratic", settings.quadratic);
-        // point light 2
-        shader.setVec3("lights[1].position", glm::vec3{hallway_width / 2, hallway_height - 0.5f, -0.5f});
-        shader.setVec3("lights[1].ambient", settings.ambient.r, settings.ambient.g, settings.ambient.b);
-        shader.setVec3("lights[1].diffuse", settings.diffuse.r, settings.diffuse.g, settings.diffuse.b);
-        shader.setVec3("lights[1].specular", settings.specular.r, settings.specular.g, settings.specular.b);
-        shader.setFloat("lights[1].constant", settings.constant);
-        shader.setFloat("lights[1].linear", settings.linear);
-        shader.setFloat("lights[1].quadratic", settings.quadratic);
-
-        shader.setFloat("shininess", settings.shininess);
-        shader.setFloat("heightScale", settings.height);
-        shader.setFloat("minLayers", static_cast<float>(settings.min_layers));
-        shader.setFloat("maxLayers", static_cast<float>(settings.max_layers));
-        shader.setVec3("viewPos", state.camera.Position);
-
-        no_normal_shader.use();
-        no_normal_shader.setMat4("view", view);
-        no_normal_shader.setMat4("projection", projection);
-        // point light 1
-        no_normal_shader.setVec3("lights[0].position", glm::vec3{hallway_width - 0.5f, hallway_height - 0.5f, -3.f * hallway_length / 4.f});
-        no_normal_shader.setVec3("lights[0].ambient", settings.ambient1.r, settings.ambient1.g, settings.ambient1.b);
-        no_normal_shader.setVec3("lights[0].diffuse", settings.diffuse1.r, settings.diffuse1.g, settings.diffuse1.b);
-        no_normal_shader.setVec3("lights[0].specular", settings.specular1.r, settings.specular1.g, settings.specular1.b);
-        no_normal_shader.setFloat("lights[0].constant", settings.constant);
-        no_normal_shader.setFloat("lights[0].linear", settings.linear);
-        no_normal_shader.setFloat("lights[0].quadratic", settings.quadratic);
-        // point light 2
-        no_normal_shader.setVec3("lights[1].position", glm::vec3{hallway_width / 2, hallway_height - 0.5f, -0.5f});
-        no_normal_shader.setVec3("lights[1].ambient", settings.ambient.r, settings.ambient.g, settings.ambient.b);
-        no_normal_shader.setVec3("lights[1].diffuse", settings.diffuse.r, settings.diffuse.g, settings.diffuse.b);
-        no_normal_shader.setVec3("lights[1].specular", settings.specular.r, settings.specular.g, settings.specular.b);
-        no_normal_shader.setFloat("lights[1].constant", settings.constant);
-        no_normal_shader.setFloat("lights[1].linear", settings.linear);
-        no_normal_shader.setFloat("lights[1].quadratic", settings.quadratic);
-
-        no_normal_shader.setFloat("shininess", settings.shininess);
-        no_normal_shader.setVec3("viewPos", state.camera.Position);
-
-        shader.use();
-
-        for (auto& plane : planes) {
-            plane.draw(shader);
-        }
-
+        const glm::mat4 view_projection = projection * view;
+        view_frustum = settings.frustum_culling ? Frustum{view_projection} : Frustum{};
         {
-            // arcade machine
-            shader.use();
-            TextureGroup::unbind();
-            glm::mat4 model(1.f);
-            model = glm::translate(model, glm::vec3(0.55f, 0.f, -hallway_length / 3.f));
-            model = glm::rotate(model, glm::pi<float>() / 2.f, glm::vec3(0.f, 1.f, 0.f));
-            model = glm::scale(model, glm::vec3(0.45f, 0.45f, 0.45f));
-            shader.setMat4("model", model);
-            arcade_model.Draw(shader);
+            const auto profile = profiler.scope("portals");
+            const std::size_t camera_cell = hallway.segment_at(state.camera.Position);
+            visible_cells = settings.portal_culling ? hallway.portals.traverse(view_projection, state.camera.Position, camera_cell)
+                                                    : hallway.portals.all(view_projection);
+            std::fill(visible_chunks.begin(), visible_chunks.end(), false);
+            for (const auto& cell : visible_cells) {
+                visible_chunks[cell.cell / hallway.chunk_segments] = true;
+            }
+            state.visible_cells = visible_cells.size();
+            state.cell_count = hallway.portals.cell_count();
         }
-
-        {
-            // trash
-            shader.use();
-            TextureGroup::unbind();
-            glm::mat4 model(1.f);
-            model = glm::translate(model, glm::vec3(hallway_width / 2.f, 0.f, -1.f));
-            shader.setMat4("model", model);
-            trash_model.Draw(shader);
+        if (settings.occlusion_culling) {
+            const auto profile = profiler.scope("occlusion culling");
+            occlusion_culler.begin_frame(view_projection);
+            for (std::size_t chunk = 0; chunk < wall_occluders.size(); chunk++) {
+                if (visible_chunks[chunk]) {
+                    occlusion_culler.add(wall_occluders[chunk], glm::mat4(1.0f));
+                }
+            }
+            for (const auto& cell : visible_cells) {
+                for (const auto& [prop, occluder] : prop_occluders) {
+                    for (const auto& transform : hallway.instances(prop, cell.cell)) {
+                        occlusion_culler.add(occluder, transform);
+                    }
+                }
+            }
+            occlusion_culler.rasterize();
         }
-
-        {
-            // doors
-            no_normal_shader.use();
-            TextureGroup::unbind();
-
-            glm::mat4 model(1.0f);
-            model = glm::translate(model, glm::vec3(hallway_width - 0.1f, 0.f, -hallway_length / 2.f));
-            model = glm::rotate(model, -glm::pi<float>() / 2.f, glm::vec3(0.f, 1.f, 0.f));
-            no_normal_shader.setMat4("model", model);
-            door_model.Draw(no_normal_shader);
-
-            no_normal_shader.setMat4("model",
-                           glm::rotate(
-                                   glm::translate(glm::mat4(1.f),
-                                                  glm::vec3(hallway_width - 0.1f, 0.f, -hallway_length / 4.f)),
-                                   -glm::pi<float>() / 2.f,
-                                   glm::vec3(0.f, 1.f, 0.f)
-                           )
-            );
-            door_model.Draw(no_normal_shader);
-
-            no_normal_shader.setMat4("model", glm::translate(glm::mat4(1.f), glm::vec3(hallway_width / 2.0f, 0.f, -hallway_length + 0.1f)));
-            door_model.Draw(no_normal_shader);
+        render_queue.set_occlusion_culler(settings.occlusion_culling ? &occlusion_culler : nullptr);
+        render_queue.set_meshlet_culling(settings.meshlet_culling, state.camera.Position);
+        if (settings.level_of_detail) {
+            const auto profile = profiler.scope("lod selection");
+            lod_selector.begin_frame(state.camera.Position, glm::radians(settings.view_angle), state.window_height, settings.lod_threshold);
+            for (const auto& cell : visible_cells) {
+                for (std::size_t prop = 0; prop < prop_count; prop++) {
+                    const std::size_t first = hallway.segment_props[cell.cell][prop];
+                    const auto instances = hallway.instances(static_cast<Prop>(prop), cell.cell);
+                    for (std::size_t i = 0; i < instances.size(); i++) {
+                        std::uint8_t& level = prop_lods[prop][first + i];
+                        level = lod_selector.select(*prop_models[prop], instances[i], level);
+                    }
+                }
+            }
         }
 
+        const auto light_count = static_cast<int>(lights.size());
         {
-            // ramen machine
-            shader.use();
-            TextureGroup::unbind();
-            glm::mat4 model(1.f);
-            model = glm::translate(model, glm::vec3(0.4, 0.f, - 2.f * hallway_length / 3.f));
-            model = glm::rotate(model, glm::pi<float>() / 2.f, glm::vec3(0.f, 1.f, 0.f));
-            model = glm::scale(model, glm::vec3(1.4f, 1.4f, 1.4f));
-            shader.setMat4("model", model);
-            vending_model.Draw(shader);
+            const auto profile = profiler.scope("lights");
+            // a long hallway has more lights than fit in the uniform buffer, the ones nearest to the camera are shaded
+            if (light_order.size() > lights.size()) {
+                const auto nearer = [&](std::size_t a, std::size_t b) {
+                    const glm::vec3 to_a = light_positions[a] - state.camera.Position;
+                    const glm::vec3 to_b = light_positions[b] - state.camera.Position;
+                    return glm::dot(to_a, to_a) < glm::dot(to_b, to_b);
+                };
+                std::nth_element(light_order.begin(), light_order.begin() + static_cast<std::ptrdiff_t>(lights.size()),
+                                 light_order.end(), nearer);
+            }
+            const Attenuation attenuation{settings.constant, settings.linear, settings.quadratic};
+            for (std::size_t i = 0; i < lights.size(); i++) {
+                const std::size_t light = light_order[i];
+                lights[i] = make_light(light_positions[light], settings.light_colors[light % settings.light_colors.size()],
+                                       attenuation, settings.light_cutoff);
+            }
+            lights_uniforms.update(lights.data(), light_count * sizeof(Light));
+            light_clusters.update(lights.data(), light_count, view, projection, z_near, z_far);
+            light_clusters.bind();
         }
+        frame_uniforms.update(FrameUniforms{view, projection, glm::vec4(state.camera.Position, 1.0f), light_count, {},
+                                            light_clusters.shader_scale(state.window_width, state.window_height),
+                                            {LightClusters::tiles_x, LightClusters::tiles_y, LightClusters::slices, 0}});
 
-        {
-            // poster
-            shader.use();
-            TextureGroup::unbind();
-            glm::mat4 model(1.f);
-            model = glm::translate(model, glm::vec3(hallway_width - 0.03f, hallway_height / 2.f, - 3.f * hallway_length / 4.f));
-            model = glm::rotate(model, -glm::pi<float>() / 2.f, glm::vec3(0.f, 1.f, 0.f));
-            model = glm::scale(model, glm::vec3(1.2f, 1.2f, 1.2f));
-            shader.setMat4("model", model);
-            poster_model.Draw(shader);
-        }
+        shader.use();
+        shader.setFloat(shader_uniforms.shininess, settings.shininess);
+        shader.setFloat(shader_uniforms.height_scale, settings.height);
+        shader.setFloat(shader_uniforms.min_layers, static_cast<float>(settings.min_layers));
+        shader.setFloat(shader_uniforms.max_layers, static_cast<float>(settings.max_layers));
 
-        {
-            // bottle
-            shader.use();
-            TextureGroup::unbind();
-            glm::mat4 model(1.f);
-            model = glm::translate(model, glm::vec3(hallway_width / 3.f, 0.07f, -hallway_length / 2.f));
-            model = glm::rotate(model, glm::pi<float>() / 2.f, glm::vec3(1.f, 0.f, 0.f));
-            model = glm::rotate(model, -glm::pi<float>() / 12.f, glm::vec3(0.f, 0.f, 1.f));
-            model = glm::scale(model, glm::vec3(0.01f, 0.01f, 0.01f));
-            shader.setMat4("model", model);
-            bottle_model.Draw(shader);
-        }
+        no_normal_shader.use();
+        no_normal_shader.setFloat(no_normal_uniforms.shininess, settings.shininess);
+
+        gbuffer_shader.use();
+        gbuffer_shader.setFloat(gbuffer_uniforms.height_scale, settings.height);
+        gbuffer_shader.setFloat(gbuffer_uniforms.min_layers, static_cast<float>(settings.min_layers));
+        gbuffer_shader.setFloat(gbuffer_uniforms.max_layers, static_cast<float>(settings.max_layers));
+
+        deferred_shader.use();
+        deferred_shader.setFloat(deferred_shininess_uniform, settings.shininess);
+        deferred_shader.setMat4(deferred_inverse_view_projection_uniform, glm::inverse(view_projection));
+
+        if (settings.deferred_shading) {
+            // geometry pass
+            // -------------
+            g_buffer.bind();
+            glClearColor(0.0f, 0.0f, 0.0f, 0.0f);
+            glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+            // the alpha channel holds specular intensity, not coverage
+            glDisable(GL_BLEND);
+            if (settings.depth_pre_pass) {
+                const auto profile = profiler.scope("depth pre-pass");
+                begin_depth_pre_pass();
+            }
+            {
+                const auto profile = profiler.scope("geometry");
+                draw_scene(gbuffer_shader, gbuffer_no_normal_shader, SceneObjects::opaque);
+            }
+            if (settings.depth_pre_pass) {
+                end_depth_pre_pass();
+            }
+            glEnable(GL_BLEND);
+
+            // lighting pass
+            // -------------
+            {
+                const auto profile = profiler.scope("lighting");
+                hdr_buffer.bind();
+                glClearColor(clear_color.r, clear_color.g, clear_color.b, 1.0f);
+                glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+                g_buffer.blit_depth(hdr_buffer);
+                hdr_buffer.bind();
+                glDisable(GL_DEPTH_TEST);
+                lighting_plane.draw(deferred_shader);
+                glEnable(GL_DEPTH_TEST);
+            }
 
-        {
-            // lamp
-            shader.use();
-            TextureGroup::unbind();
-            glm::mat4 model(1.0f);
-            model = glm::translate(model, glm::vec3{hallway_width / 2, hallway_height, -0.2f});
-            model = glm::rotate(model, glm::pi<float>(), glm::vec3(1.f, 0.f, 0.f));
-            model = glm::scale(model, glm::vec3(0.03, 0.03, 0.03));
-            shader.setMat4("model", model);
-            light_model.Draw(shader);
-
-            model = glm::mat4(1.0f);
-            model = glm::translate(model, glm::vec3{hallway_width - 0.2f, hallway_height, -3.f * hallway_length / 4.f});
-            model = glm::rotate(model, glm::pi<float>(), glm::vec3(1.f, 0.f, 0.f));
-            model = glm::rotate(model, glm::pi<float>() / 2, glm::vec3(0.f, 1.f, 0.f));
-            model = glm::scale(model, glm::vec3(0.03, 0.03, 0.03));
-            shader.setMat4("model", model);
-            light_model.Draw(shader);
+            // transparent objects can't be stored in the G-buffer, they are shaded forward on top
+            const auto profile = profiler.scope("transparent");
+            draw_scene(shader, no_normal_shader, SceneObjects::transparent);
+        } else {
+            // render to framebuffer
+            // ---------------------
+            hdr_buffer.bind();
+            glClearColor(clear_color.r, clear_color.g, clear_color.b, 1.0f);
+            glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+            // the opaque queue is sorted by state, not depth, so only the transparent pass may blend
+            glDisable(GL_BLEND);
+            if (settings.depth_pre_pass) {
+                const auto profile = profiler.scope("depth pre-pass");
+                begin_depth_pre_pass();
+            }
+            {
+                const auto profile = profiler.scope("forward");
+                draw_scene(shader, no_normal_shader, SceneObjects::opaque);
+            }
+            if (settings.depth_pre_pass) {
+                end_depth_pre_pass();
+            }
+            glEnable(GL_BLEND);
+            const auto profile = profiler.scope("transparent");
+            draw_scene(shader, no_normal_shader, SceneObjects::transparent);
         }
 
         Framebuffer::unbind();
@@ -816,15 +1114,19 @@ int main() {
         if (settings.bloom) {
             // extract bright fragments
             // ------------------------
-            bright_buffer.bind();
-            glClearColor(clear_color.r, clear_color.g, clear_color.b, 1.0f);
-            glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-            bright_shader.use();
-            screen_plane.draw(bright_shader);
-            Framebuffer::unbind();
+            {
+                const auto profile = profiler.scope("bright extraction");
+                bright_buffer.bind();
+                glClearColor(clear_color.r, clear_color.g, clear_color.b, 1.0f);
+                glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+                bright_shader.use();
+                screen_plane.draw(bright_shader);
+                Framebuffer::unbind();
+            }
 
             // blur bright fragments
             // ---------------------
+            const auto profile = profiler.scope("blur");
             blur_buffer.bind();
             glClearColor(clear_color.r, clear_color.g, clear_color.b, 1.0f);
             glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
@@ -849,23 +1151,37 @@ int main() {
 
         // tone-mapping
         // ------------
-        glClearColor(clear_color.r, clear_color.g, clear_color.b, 1.0f);
-        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-
-        screen_shader.use();
-        screen_shader.setFloat("gamma", settings.gamma);
-        screen_shader.setFloat("exposure", settings.exposure);
-        bright_plane.draw(screen_shader);
+        {
+            const auto profile = profiler.scope("tone mapping");
+            glClearColor(clear_color.r, clear_color.g, clear_color.b, 1.0f);
+            glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
+            screen_shader.use();
+            screen_shader.setFloat(screen_gamma_uniform, settings.gamma);
+            screen_shader.setFloat(screen_exposure_uniform, settings.exposure);
+            bright_plane.draw(screen_shader);
+        }
 
         if (state.gui_enabled) {
-            draw_gui(settings, fps_counter);
+            const auto profile = profiler.scope("gui");
+            draw_gui(settings, state, fps_counter, profiler, render_queue.statistics());
         }
 
         // glfw: swap buffers and poll IO events
         // -------------------------------------------------------------------------------
         glfwSwapBuffers(window);
         glfwPollEvents();
+        recorder.end_frame(profiler);
+    }
+
+    if (benchmark) {
+        try {
+            recorder.write(benchmark->output, *benchmark);
+        } catch (const std::exception& e) {
+            std::cerr << e.what() << std::endl;
+            return -1;
+        }
+        std::cout << "Benchmark results written to " << benchmark->output << std::endl;
     }
 
     return 0;
@@ -0,0 +1,48 @@
+//
+// Portal traversal: a camera passing through a portal must keep seeing the cell behind it.
+//
+
+#include <portals.h>
+
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <cstddef>
+#include <iostream>
+
+namespace {
+
+// two cells of a corridor looking down -z, split by a portal at z = -5
+PortalGraph corridor()
+{
+    PortalGraph graph{2};
+    graph.add_portal(0, 1, {glm::vec3{0.f, 0.f, -5.f}, {4.f, 0.f, -5.f}, {4.f, 3.f, -5.f}, {0.f, 3.f, -5.f}});
+    return graph;
+}
+
+std::size_t visible_cells(const glm::vec3& camera_position)
+{
+    const glm::mat4 projection = glm::perspective(glm::radians(45.f), 16.f / 9.f, 0.1f, 100.f);
+    const glm::mat4 view = glm::lookAt(camera_position, camera_position + glm::vec3{0.f, 0.f, -1.f}, glm::vec3{0.f, 1.f, 0.f});
+    PortalGraph graph = corridor();
+    return graph.traverse(projection * view, camera_position, 0).size();
+}
+
+bool check(bool condition, const char* description)
+{
+    if (!condition) {
+        std::cerr << "FAILED: " << description << std::endl;
+    }
+    return condition;
+}
+
+} // namespace
+
+int main()
+{
+    bool passed = true;
+    passed &= check(visible_cells({2.f, 1.5f, -1.f}) == 2, "the next cell is visible through the portal");
+    passed &= check(visible_cells({2.f, 1.5f, -4.95f}) == 2, "the next cell stays visible when the portal is closer than the near plane");
+    passed &= check(visible_cells({6.f, 1.5f, -4.95f}) == 1, "a portal beside the camera doesn't show the next cell");
+    return passed ? 0 : 1;
+}
@@ -0,0 +1,311 @@
+//
+// Offline texture cooking: converts images into block compressed DDS files with a full mip chain, which
+// TextureLoader uploads with glCompressedTexImage2D instead of decoding the image and generating mip maps.
+//
+// usage: cook_textures [--flip] [--force] image...
+//   writes image.dds next to every image, or image.flipped.dds with --flip for textures loaded flipped.
+//   Normal maps (_NRM or _normal in the name) become BC5 with only x and y, images with transparency
+//   BC3 and everything else BC1. Up to date outputs are skipped unless --force is given.
+//
+
+#include <dds.h>
+#include <stb_image.h>
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <filesystem>
+#include <iostream>
+#include <string>
+#include <vector>
+
+namespace {
+
+struct Rgba
+{
+    float r, g, b, a;
+};
+
+struct Surface
+{
+    int width{};
+    int height{};
+    std::vector<Rgba> pixels;
+
+    [[nodiscard]] const Rgba& at(int x, int y) const
+    {
+        return pixels[static_cast<std::size_t>(std::min(y, height - 1)) * width + std::min(x, width - 1)];
+    }
+};
+
+// maps the x and y of a normal map texel to [-1, 1], renormalizes it and back, z is dropped by BC5 anyway
+Rgba renormalize(Rgba texel)
+{
+    const float x = texel.r / 127.5f - 1.0f;
+    const float y = texel.g / 127.5f - 1.0f;
+    const float z = texel.b / 127.5f - 1.0f;
+    const float length = std::sqrt(x * x + y * y + z * z);
+    if (length < 1e-6f) {
+        return texel;
+    }
+    return {(x / length + 1.0f) * 127.5f, (y / length + 1.0f) * 127.5f, (z / length + 1.0f) * 127.5f, texel.a};
+}
+
+// 2x2 box filter, odd sizes repeat the last row or column
+Surface downsample(const Surface& surface, bool normal_map)
+{
+    Surface result{std::max(surface.width / 2, 1), std::max(surface.height / 2, 1), {}};
+    result.pixels.resize(static_cast<std::size_t>(result.width) * result.height);
+    for (int y = 0; y < result.height; y++) {
+        for (int x = 0; x < result.width; x++) {
+            Rgba sum{};
+            for (int dy = 0; dy < 2; dy++) {
+                for (int dx = 0; dx < 2; dx++) {
+                    const Rgba& texel = surface.at(2 * x + dx, 2 * y + dy);
+                    sum = {sum.r + texel.r, sum.g + texel.g, sum.b + texel.b, sum.a + texel.a};
+                }
+            }
+            const Rgba average{sum.r / 4.0f, sum.g / 4.0f, sum.b / 4.0f, sum.a / 4.0f};
+            result.pixels[static_cast<std::size_t>(y) * result.width + x] = normal_map ? renormalize(average) : average;
+        }
+    }
+    return result;
+}
+
+std::uint8_t to_byte(float value)
+{
+    return static_cast<std::uint8_t>(std::clamp(std::lround(value), 0l, 255l));
+}
+
+std::uint16_t to_565(const std::array<float, 3>& color)
+{
+    const auto r = static_cast<std::uint16_t>(std::clamp(std::lround(color[0] * 31.0f / 255.0f), 0l, 31l));
+    const auto g = static_cast<std::uint16_t>(std::clamp(std::lround(color[1] * 63.0f / 255.0f), 0l, 63l));
+    const auto b = static_cast<std::uint16_t>(std::clamp(std::lround(color[2] * 31.0f / 255.0f), 0l, 31l));
+    return static_cast<std::uint16_t>(r << 11 | g << 5 | b);
+}
+
+std::array<float, 3> from_565(std::uint16_t color)
+{
+    const int r = color >> 11 & 31;
+    const int g = color >> 5 & 63;
+    const int b = color & 31;
+    return {static_cast<float>(r << 3 | r >> 2), static_cast<float>(g << 2 | g >> 4), static_cast<float>(b << 3 | b >> 2)};
+}
+
+void put16(std::vector<std::uint8_t>& out, std::uint16_t value)
+{
+    out.push_back(static_cast<std::uint8_t>(value));
+    out.push_back(static_cast<std::uint8_t>(value >> 8));
+}
+
+// BC1 color block: the endpoints are the extremes of the colors along their principal axis
+void encode_bc1(const std::array<std::array<float, 3>, 16>& colors, std::vector<std::uint8_t>& out)
+{
+    std::array<float, 3> mean{};
+    for (const auto& c : colors) {
+        for (int i = 0; i < 3; i++) {
+            mean[i] += c[i] / 16.0f;
+        }
+    }
+    float covariance[3][3]{};
+    for (const auto& c : colors) {
+        for (int i = 0; i < 3; i++) {
+            for (int j = 0; j < 3; j++) {
+                covariance[i][j] += (c[i] - mean[i]) * (c[j] - mean[j]);
+            }
+        }
+    }
+    // power iteration for the principal axis
+    std::array<float, 3> axis{1.0f, 1.0f, 1.0f};
+    for (int iteration = 0; iteration < 8; iteration++) {
+        std::array<float, 3> next{};
+        for (int i = 0; i < 3; i++) {
+            next[i] = covariance[i][0] * axis[0] + covariance[i][1] * axis[1] + covariance[i][2] * axis[2];
+        }
+        const float length = std::max({std::abs(next[0]), std::abs(next[1]), std::abs(next[2])});
+        if (length < 1e-6f) {
+            break;
+        }
+        axis = {next[0] / length, next[1] / length, next[2] / length};
+    }
+    const auto project = [&](const std::array<float, 3>& c) {
+        return (c[0] - mean[0]) * axis[0] + (c[1] - mean[1]) * axis[1] + (c[2] - mean[2]) * axis[2];
+    };
+    const auto [min_it, max_it] = std::minmax_element(colors.begin(), colors.end(),
+                                                      [&](const auto& a, const auto& b) { return project(a) < project(b); });
+
+    std::uint16_t color0 = to_565(*max_it);
+    std::uint16_t color1 = to_565(*min_it);
+    if (color0 < color1) {
+        std::swap(color0, color1);
+    }
+    std::uint32_t indices = 0;
+    // color0 > color1 selects the four color mode, equal endpoints leave all indices at 0
+    if (color0 != color1) {
+        const auto c0 = from_565(color0);
+        const auto c1 = from_565(color1);
+        std::array<std::array<float, 3>, 4> palette{c0, c1, std::array<float, 3>{}, std::array<float, 3>{}};
+        for (int i = 0; i < 3; i++) {
+            palette[2][i] = (2.0f * c0[i] + c1[i]) / 3.0f;
+            palette[3][i] = (c0[i] + 2.0f * c1[i]) / 3.0f;
+        }
+        for (int p = 0; p < 16; p++) {
+            std::uint32_t best = 0;
+            float best_distance = INFINITY;
+            for (std::uint32_t i = 0; i < 4; i++) {
+                float distance = 0.0f;
+                for (int j = 0; j < 3; j++) {
+                    distance += (colors[p][j] - palette[i][j]) * (colors[p][j] - palette[i][j]);
+                }
+                if (distance < best_distance) {
+                    best_distance = distance;
+                    best = i;
+                }
+            }
+            indices |= best << (2 * p);
+        }
+    }
+    put16(out, color0);
+    put16(out, color1);
+    put16(out, static_cast<std::uint16_t>(indices));
+    put16(out, static_cast<std::uint16_t>(indices >> 16));
+}
+
+// BC4 single channel block, used for the alpha of BC3 and both channels of BC5
+void encode_bc4(const std::array<float, 16>& values, std::vector<std::uint8_t>& out)
+{
+    const auto [min_it, max_it] = std::minmax_element(values.begin(), values.end());
+    const std::uint8_t value0 = to_byte(*max_it);
+    const std::uint8_t value1 = to_byte(*min_it);
+    std::uint64_t indices = 0;
+    // value0 > value1 selects the eight value mode, equal endpoints leave all indices at 0
+    if (value0 != value1) {
+        std::array<float, 8> palette{static_cast<float>(value0), static_cast<float>(value1)};
+        for (int i = 1; i <= 6; i++) {
+            palette[i + 1] = (static_cast<float>(7 - i) * value0 + static_cast<float>(i) * value1) / 7.0f;
+        }
+        for (int p = 0; p < 16; p++) {
+            std::uint64_t best = 0;
+            float best_distance = INFINITY;
+            for (std::uint64_t i = 0; i < 8; i++) {
+                const float distance = std::abs(values[p] - palette[i]);
+                if (distance < best_distance) {
+                    best_distance = distance;
+                    best = i;
+                }
+            }
+            indices |= best << (3 * p);
+        }
+    }
+    out.push_back(value0);
+    out.push_back(value1);
+    for (int i = 0; i < 6; i++) {
+        out.push_back(static_cast<std::uint8_t>(indices >> (8 * i)));
+    }
+}
+
+std::vector<std::uint8_t> encode(const Surface& surface, std::uint32_t format)
+{
+    std::vector<std::uint8_t> out;
+    out.reserve(dds::level_size(format, surface.width, surface.height));
+    for (int block_y = 0; block_y < surface.height; block_y += 4) {
+        for (int block_x = 0; block_x < surface.width; block_x += 4) {
+            std::array<std::array<float, 3>, 16> colors{};
+            std::array<float, 16> reds{}, greens{}, alphas{};
+            for (int p = 0; p < 16; p++) {
+                // blocks crossing the edge repeat the last row or column
+                const Rgba& texel = surface.at(block_x + p % 4, block_y + p / 4);
+                colors[p] = {texel.r, texel.g, texel.b};
+                reds[p] = texel.r;
+                greens[p] = texel.g;
+                alphas[p] = texel.a;
+            }
+            if (format == dds::bc5) {
+                encode_bc4(reds, out);
+                encode_bc4(greens, out);
+            } else {
+                if (format == dds::bc3) {
+                    encode_bc4(alphas, out);
+                }
+                encode_bc1(colors, out);
+            }
+        }
+    }
+    return out;
+}
+
+bool is_normal_map(const std::filesystem::path& path)
+{
+    const std::string name = path.filename().string();
+    return name.find("_NRM") != std::string::npos || name.find("_normal") != std::string::npos;
+}
+
+bool cook(const std::filesystem::path& source, bool flip, bool force)
+{
+    const std::filesystem::path output = source.string() + (flip ? ".flipped.dds" : ".dds");
+    std::error_code error;
+    if (!force && std::filesystem::exists(output, error) &&
+        std::filesystem::last_write_time(output, error) >= std::filesystem::last_write_time(source, error)) {
+        return true;
+    }
+
+    int width{}, height{}, channels{};
+    stbi_uc* data = stbi_load(source.string().c_str(), &width, &height, &channels, 4);
+    if (!data) {
+        std::cerr << "Can't load " << source.string() << std::endl;
+        return false;
+    }
+    Surface surface{width, height, {}};
+    surface.pixels.reserve(static_cast<std::size_t>(width) * height);
+    bool transparent = false;
+    for (int y = 0; y < height; y++) {
+        const int row = flip ? height - 1 - y : y;
+        for (int x = 0; x < width; x++) {
+            const stbi_uc* texel = data + (static_cast<std::size_t>(row) * width + x) * 4;
+            surface.pixels.push_back({static_cast<float>(texel[0]), static_cast<float>(texel[1]),
+                                      static_cast<float>(texel[2]), static_cast<float>(texel[3])});
+            transparent = transparent || texel[3] < 255;
+        }
+    }
+    stbi_image_free(data);
+
+    const bool normal_map = is_normal_map(source);
+    dds::Image image{normal_map ? dds::bc5 : transparent ? dds::bc3 : dds::bc1,
+                     static_cast<std::uint32_t>(width), static_cast<std::uint32_t>(height), {}};
+    while (true) {
+        image.levels.push_back(encode(surface, image.format));
+        if (surface.width == 1 && surface.height == 1) {
+            break;
+        }
+        surface = downsample(surface, normal_map);
+    }
+
+    if (!dds::write(output.string(), image)) {
+        std::cerr << "Can't write " << output.string() << std::endl;
+        return false;
+    }
+    std::cout << "Cooked " << output.string() << (normal_map ? " as BC5" : transparent ? " as BC3" : " as BC1") << std::endl;
+    return true;
+}
+
+} // namespace
+
+int main(int argc, char** argv)
+{
+    bool flip = false;
+    bool force = false;
+    bool success = true;
+    for (int i = 1; i < argc; i++) {
+        const std::string arg = argv[i];
+        if (arg == "--flip") {
+            flip = true;
+        } else if (arg == "--force") {
+            force = true;
+        } else {
+            success = cook(arg, flip, force) && success;
+        }
+    }
+    return success ? 0 : 1;
+}